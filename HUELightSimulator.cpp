@@ -10,79 +10,248 @@
 #include <iostream>
 #include <curl/curl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <time.h>
 #include "./inc/cmdparser.hpp"
 #include "./inc/HUELightSimulator.h"
+#include "./inc/ConnectionPool.h"
+#include "./inc/ConcurrentFetcher.h"
+#include "./inc/EventLoop.h"
+#include "./inc/WorkStealingPool.h"
+#include "./inc/ResponseFingerprints.h"
+#include "./inc/ConditionalRequests.h"
+#include "./inc/SampleScheduler.h"
+#include "./inc/AdaptivePolling.h"
+#include "./inc/RateLimiter.h"
+#include "./inc/CircuitBreakers.h"
+#include "./inc/LatencyWindow.h"
+#include "./inc/PipelinedHTTPClient.h"
+#include "./inc/EventStreamParser.h"
+#include "./inc/LightSaxParser.h"
+#include "./inc/LightSchemaParser.h"
+#include "./inc/SimdLightScanner.h"
+#include "./inc/StreamingLightParser.h"
+#include "./inc/ParserVerifier.h"
+#include "./inc/AllocationCounter.h"
 
 using namespace std;
 using json = nlohmann::json;
 using ordered_json = nlohmann::ordered_json;
 
 /**
- *	This function attempts a provided amount of connections to the server. If it fails after the nth time,
- *	  the server is assumed to be off and the program ends.  *
- *
- *
- * @param retryAttempts Number of times to retry the request
- * @param sleep   	Time in microseconds bewteen each GET request.
- * @param curl 		Handle to the easy Curl object we set up previously (trying to reconnect with)
- * @return Bool 	Success or failure of connecting to the server after retrying
+ * Everything that is kept about one bridge between samples. RunProgram monitors one of these, fleet mode monitors one per
+ * line of the fleet file.
  */
-bool AttemptHTTPRequestRetry(int retryAttempts, int sleepTime, CURL *curl) {
-  	CURLcode res;
-	int attempt = 1;
-
-  	// Try retryAttempts to reach the server
-	while (attempt < retryAttempts) {
-
-	    res = curl_easy_perform(curl);
-
-	        if(res != CURLE_OK) {
-	      		fprintf(stderr, "curl_easy_perform() failed attempt %d: %s\n", attempt, curl_easy_strerror(res));
-
-	      		attempt++;
-	        } else {
-	        	// Revieved OK from server, continue processing requests
-	        	return true;
-	        }
-
-		usleep(sleepTime);
+struct BridgeMonitor {
+	string name;				// Identifier printed with the changes in fleet mode ("" when monitoring a single bridge)
+	string hostname;
+	int port;
+	string urlString;			// URL of the "Query all" request
+	string lightsPath;			// Path of the "Query all" request (pipelining client)
+	chrono::steady_clock::time_point created;	// When monitoring the bridge started
+	bool warmedUp;				// PrepareBridge ran
+	ConnectionPool pool;		// Keeps the connections to the bridge alive between requests and samples
+	ConcurrentFetcher fetcher;	// Runs the per-light requests side by side when more than one is allowed in flight
+	SimulationStats stats;
+	LatencyWindow sampleTimes;	// Time the latest samples took, for the percentiles
+	ResponseFingerprints fingerprints;	// Lets unchanged responses skip parsing and comparing
+	ConditionalRequests conditional;	// Lets the bridge answer 304 instead of sending an unchanged body
+	CircuitBreakers breakers;	// Backoff of the endpoints (collection and lights) that failed
+	SampleScheduler scheduler;	// Deadlines of the samples
+	AdaptivePolling adaptive;	// Moves the interval of the scheduler with the change activity (adaptive polling mode)
+	RateLimiter limiter;		// Every request to the bridge waits for a token here
+	vector<HueLight> currentLightsState;
+	ReceiveBuffer responseString;	// Response of the "Query all" request
+	vector<FetchRequest> lightRequests;	// Individual light requests, kept between samples so their buffers keep their capacity
+	PipelinedHTTPClient http;	// Sends the requests instead of libcurl in pipelining mode
+	vector<PipelinedRequest> pipelinedRequests;	// Light requests of the pipelining client, kept between samples
+	SimdLightScanner scanner;	// Parses the responses with the "simd" parser, keeps its index between responses
+	ParserVerifier verifier;	// Checks the JSON parser against the DOM parser (--verifyParser)
+	StreamingLightParser streamer;	// Parses the "Query all" response while it is received (--jsonParser stream)
+	vector<bool> refreshLights;	// Per light ID - 1, whether its details are requested this sample (see PickLightsToRefresh)
+	vector<int> knownLights;	// Per light ID - 1, its index in currentLightsState (-1 = not known), see IndexKnownLights
+	int refreshCursor;			// Index of the light the next slice starts at
+	int runCount;
+
+	BridgeMonitor(const string &name, const string &hostname, int port, const string &username, const SimulationOptions &options) :
+		name(name),
+		hostname(hostname),
+		port(port),
+		urlString("http://"+hostname+":"+to_string(port)+"/api/"+username+"/lights/"),
+		lightsPath("/api/"+username+"/lights/"),
+		created(chrono::steady_clock::now()),
+		warmedUp(false),
+		fetcher(options.maxInFlight, 1),
+		sampleTimes(1000),
+		breakers(3, 100, 30000),
+		scheduler(options.sleep, options.catchUp),
+		adaptive(options.minInterval, options.maxInterval, options.sleep),
+		limiter(options.rateLimit, options.burst),
+		http(hostname, port),
+		refreshCursor(0),
+		runCount(0) {
+		scheduler.SetInterval(adaptive.interval);
+		fetcher.SetRateLimiter(&limiter);
+		pool.SetUnixSocket(options.unixSocket);
+		http.SetUnixSocket(options.unixSocket);
+		SimdLightScanner::KernelFromName(options.simdKernel, scanner.kernel);
 	}
-
-	return false;
-}
-
+};
 
 /**
- * Creates the CURL handle with the setup parameters
+ * Creates the CURL handle with the setup parameters. The handle comes from the bridge's connection pool, so it may be one that was
+ * already used for an earlier request to the same host:port (and still holds its kept-alive connection).
+ * Give it back with bridge.pool.Release instead of calling curl_easy_cleanup.
  *
  *
+ * The validators the server sent for the URL last time (ETag / Last-Modified) are sent along, so pass the response to
+ * bridge.conditional.Finish once the request succeeded: a "304 Not Modified" is turned back into the last body there.
+ *
+ *
+ * @param bridge 		Bridge the request goes to (its connection pool and remembered validators are used).
  * @param urlString 	String to use for URL connection.
- * @param timeout 		Time in seconds before a timeout on the GET request.
+ * @param options 		Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param responseString Buffer the response is collected in.
  * @return CURL* 		Pointer to CURL handle to be used in future HTTP requests.
  */
-CURL* CreateHTTPCurlHandle(char* url, int timeout, string* responseString) {
+CURL* CreateHTTPCurlHandle(BridgeMonitor &bridge, const string &urlString, const SimulationOptions &options, ReceiveBuffer* responseString) {
 	CURL *curl;
 
-    curl = curl_easy_init();
+    curl = bridge.pool.Acquire(ConnectionPool::KeyFromURL(urlString));
+
+    if (!curl) {
+    	return NULL;
+    }
 
-	// Provide the url to use in the request
-	curl_easy_setopt(curl, CURLOPT_URL, url);
+	// Provide the url to use in the request (libcurl keeps its own copy of the string)
+	curl_easy_setopt(curl, CURLOPT_URL, urlString.c_str());
 
 	// Specify the HTTP protocl version. The server runs on 1.1
 	curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
 
 	// Set timeout field (seconds)
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long)options.timeout);
+
+    // Offer compressed bodies. libcurl inflates them as they arrive, so writeFunction still gets plain JSON.
+    // NULL turns it off again on a pooled handle.
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, options.compressed ? "gzip, deflate" : NULL);
 
 	// Save the value returned into a json object
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFunction);
 
-    // The string to collect the response in
+    // The buffer to collect the response in
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, responseString);
 
+    // Ask for the body only if it changed since the last response
+    bridge.conditional.Prepare(curl, urlString);
+
     return curl;
 }
 
+/**
+ * Collects the "Query all" response like writeFunction does, and parses the members of the collection that are complete
+ * every time a piece of it arrives (--jsonParser stream).
+ */
+size_t streamingWriteFunction(void *ptr, size_t size, size_t nmemb, BridgeMonitor* bridge) {
+	bridge->responseString.Append((char*) ptr, size * nmemb);
+	bridge->streamer.Feed(bridge->responseString.Begin(), bridge->responseString.End());
+	return size * nmemb;
+}
+
+/**
+ * Have the "Query all" response of a handle from CreateHTTPCurlHandle parsed while it is received, when the stream
+ * parser was picked (--jsonParser stream). ParseCollectionResponse takes the result once the transfer is over.
+ *
+ * @param bridge 	Bridge the request goes to (the response is collected in its responseString)
+ * @param curl 		Handle of the "Query all" request
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ */
+void StreamCollectionResponse(BridgeMonitor &bridge, CURL *curl, const SimulationOptions &options) {
+	if (options.jsonParser != "stream") {
+		return;
+	}
+
+	bridge.streamer.Reset(options.snapshot);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, streamingWriteFunction);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &bridge);
+}
+
+/**
+ *
+ * Start a state change event for a light. When monitoring a fleet the event is tagged with the bridge it came from.
+ *
+ * @param bridge 	Identifier of the bridge ("" when monitoring a single bridge)
+ * @param id 		ID of the light that changed
+ * @return ordered_json Event to add the changed field to
+ */
+ordered_json ChangeEvent(const string &bridge, int id) {
+	ordered_json j;
+
+	if (!bridge.empty()) {
+		j["bridge"] = bridge;
+	}
+	j["id"] = id;
+
+	return j;
+}
+
+/**
+ *
+ * Update one field of a known light, printing the change event when the value is different.
+ *
+ * @param field 	Field of the known light
+ * @param value 	Value found on the server
+ * @param name 		Name of the field in the change event
+ * @param id 		ID of the light
+ * @param out 		Stream the change is printed to
+ * @param bridge 	Identifier of the bridge the light belongs to ("" when monitoring a single bridge)
+ * @return Integer 	Number of changes printed (0 or 1)
+ */
+template <typename T>
+int UpdateLightField(T &field, const T &value, const char *name, int id, ostream &out, const string &bridge) {
+	if (field == value) {
+		return 0;
+	}
+
+	ordered_json j = ChangeEvent(bridge, id);
+	j[name] = value;
+	out<<j.dump(4)<<endl;
+
+	field = value;
+	return 1;
+}
+
+/**
+ *
+ * Print a light that was not known before.
+ *
+ * @param light 	The new light
+ * @param out 		Stream it is printed to
+ * @param bridge 	Identifier of the bridge the light belongs to ("" when monitoring a single bridge)
+ */
+void PrintDiscoveredLight(const HueLight &light, ostream &out, const string &bridge) {
+	out<<"New light has been discovered id="<<light.id<<(bridge.empty() ? "" : " on bridge " + bridge)<<"\n"<<to_json(light).dump(4)<<endl;
+}
+
+/**
+ *
+ * Print a known light that is gone.
+ *
+ * @param id 		ID of the light
+ * @param out 		Stream it is printed to
+ * @param bridge 	Identifier of the bridge the light belongs to ("" when monitoring a single bridge)
+ */
+void PrintRemovedLight(int id, ostream &out, const string &bridge) {
+	out<<"No longer receiving communication from light ID: "<<id<<(bridge.empty() ? "" : " on bridge " + bridge)<<". Removing it from known lights"<<endl;
+}
+
 /**
  *
  * This function compares and updates the new light situation to the light state in memory. We need a way to compare
@@ -91,64 +260,48 @@ CURL* CreateHTTPCurlHandle(char* url, int timeout, string* responseString) {
  *
  *
  * @param currentLightsState 	Vector of HueLight objects that were found on the server last request
- * @param newLights 			Vector of HueLight objects that were found on the server in the most recent request
+ * @param newLights 			Vector of HueLight objects that were found on the server in the most recent request (the
+ * 								lights that were discovered are moved out of it into currentLightsState)
+ * @param out 					Stream the changes are printed to
+ * @param bridge 				Identifier of the bridge the lights belong to ("" when monitoring a single bridge)
+ * @return Integer 				Number of changes printed
  */
-void CompareAndUpdateLightStates(vector<HueLight> &currentLightsState, vector<HueLight> newLights) {
+int CompareAndUpdateLightStates(vector<HueLight> &currentLightsState, vector<HueLight> &newLights, ostream &out, const string &bridge) {
+	int changes = 0;
+
 	// First set the isValid on all of the currentLights to false. Then we will iterate over and mark each one
 	//	as valid. This will show if any lights have gone offline since the last request.
 	setIsValid(currentLightsState, false);
 
-	for (auto light : newLights) {
+	for (HueLight &light : newLights) {
 		// Find the light in currentLightsState
 		int lightId = light.id;
 		int foundIt = false;
-		int index = 0;
 
 		// Check that all current lights are still valid, and if they are, check for changes
-		for (auto existinglight : currentLightsState) {
+		for (HueLight &existinglight : currentLightsState) {
 			if (existinglight.id == light.id) {
 				foundIt = true;
-				currentLightsState.at(index).isValid = true;
-				//For debugging: cout<<"For debugging: Found valid light "<< currentLightsState.at(index).id<< " updated isValid = "<<currentLightsState.at(index).isValid<<endl;
+				existinglight.isValid = true;
+				existinglight.stale = light.stale;
+				//For debugging: cout<<"For debugging: Found valid light "<< existinglight.id<< " updated isValid = "<<existinglight.isValid<<endl;
 
 				// "brightness", "on", and "name" can change
-				// Can two things change at once? yes --> do power then brightness
-				if (light.on != existinglight.on) {
-					json j = ordered_json{ {"id", light.id}, {"on", light.on}};
-
-					cout<<j.dump(4)<<endl;
-
-					// Update the curentLightState
-					currentLightsState.at(index).on = light.on;
-				}
-				if (light.brightness != existinglight.brightness) {
-					ordered_json j = ordered_json{ {"id", light.id}, {"brightness", light.brightness}};
-
-					cout<<j.dump(4)<<endl;
-
-					// Update the curentLightState
-					currentLightsState.at(index).brightness = light.brightness;
-				}
-				if (light.name != existinglight.name) {
-					ordered_json j = ordered_json{ {"id", light.id}, {"name", light.name}};
-
-					cout<<j.dump(4)<<endl;
-
-					// Update the curentLightState
-					currentLightsState.at(index).name = light.name;
-				}
+				// Can two things change at once? yes --> do power then brightness. Updates the curentLightState
+				changes += UpdateLightField(existinglight.on, light.on, "on", light.id, out, bridge);
+				changes += UpdateLightField(existinglight.brightness, light.brightness, "brightness", light.id, out, bridge);
+				changes += UpdateLightField(existinglight.name, light.name, "name", light.id, out, bridge);
 				// Do not search anymore in the vector once you have found it
-				continue;
+				break;
 			}
-
-			index++;
 		}
 		if (!foundIt) {
 			// What if new light has been added? --> if light in newLights does not exist in currentLightsState, then add it.
-			cout<<"New light has been discovered id="<<light.id<<"\n"<<to_json(light).dump(4)<<endl;
+			PrintDiscoveredLight(light, out, bridge);
 
 			light.isValid = true;
-			currentLightsState.push_back(light);
+			currentLightsState.push_back(std::move(light));
+			changes++;
 		}
 	}
 
@@ -157,286 +310,2204 @@ void CompareAndUpdateLightStates(vector<HueLight> &currentLightsState, vector<Hu
 		if (!currentLightsState.at(i).isValid) {
 			// This means we did not detect a light that existed last pass through. It must have gone offline or had an error.
 			// Remove it from the currentLightSet
-			cout<<"No longer receiving communication from light ID: "<< currentLightsState.at(i).id<<". Removing it from known lights"<<endl;
+			PrintRemovedLight(currentLightsState.at(i).id, out, bridge);
 			currentLightsState.erase(currentLightsState.begin() + i);
+			changes++;
 		}
 	}
+
+	return changes;
+}
+
+/**
+ * Check whether a sample found exactly the known lights: the same IDs, each as stale or fresh as it is known. Only then
+ * can a sample whose responses were all unchanged skip CompareAndUpdateLightStates; a light that went missing, came back
+ * or turned stale has to be compared even when every response that did arrive was byte-identical.
+ *
+ * @param lights 				Lights found on the server in the most recent request
+ * @param currentLightsState 	Lights known from the last request
+ * @return Bool 				True when both hold the same lights
+ */
+bool SameLightsAsKnown(const vector<HueLight> &lights, const vector<HueLight> &currentLightsState) {
+	if (lights.size() != currentLightsState.size()) {
+		return false;
+	}
+
+	vector<pair<int, bool> > found, known;
+	found.reserve(lights.size());
+	known.reserve(currentLightsState.size());
+	for (const HueLight &light : lights) found.push_back(make_pair(light.id, light.stale));
+	for (const HueLight &light : currentLightsState) known.push_back(make_pair(light.id, light.stale));
+
+	sort(found.begin(), found.end());
+	sort(known.begin(), known.end());
+	return found == known;
 }
 
 /**
  * Make the HTTP request via the CURL handle. The response string is saved into the preset string 
- * from the curl handle.
+ * from the curl handle. A failed request is not retried here: the caller records it in the circuit breakers and the
+ * request is tried again on a later sample, so a failing endpoint never holds up the sample.
  *
  * @param curl 			Pointer to CURL handle to be used in HTTP requests.
- * @param sleep   		Time in microseconds bewteen each GET request.
- * @param retryAttempts Attemps to retry making a connection with the server before giving up. 
+ * @param limiter 		Rate limiter the request waits for
  * @return Bool 		Success or failure of request 		
  */
-bool MakeHTTPRequest(CURL* curl, int sleep, int retryAttempts) {
+bool MakeHTTPRequest(CURL* curl, RateLimiter &limiter) {
   	CURLcode res;
-	// Make the request
+	// Make the request once the rate limiter lets it go
+	limiter.Acquire();
     res = curl_easy_perform(curl);
 
-	// If we are unable to make a connection to the server, retry a set number of times
     if(res != CURLE_OK) {
-  		fprintf(stderr, "Function MakeHTTPRequest: curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-  		// If we cannot reach the server after retryAttempts, exit the program with error code
-  		if (!AttemptHTTPRequestRetry(retryAttempts, sleep, curl)) {
-  			char *url = NULL;
-  			
-  			curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
-
-  			printf("\nUnable to establish connection to server at %s.\n", url);
-  			return false;
-  		}
-  		else {
-    		printf("Able to re-establish connection to server. Proceed.\n");
-  		}
+  		char *url = NULL;
+  		curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+
+  		fprintf(stderr, "Function MakeHTTPRequest: curl_easy_perform() failed for %s: %s\n", url, curl_easy_strerror(res));
+  		return false;
     }
 
     return true;
 }
 
-
 /**
- * Get the individual Light objects from the server given the number of lights the server has running.
+ * Same as MakeHTTPRequest, through the built-in pipelining HTTP/1.1 client instead of libcurl (pipelining mode).
  *
- * @param url 		String url to connect to
- * @param timeout 	Time in seconds before a timeout on the GET request.
- * @param elements 	Number of elements found in the "Query all" GET request
- * @return vector<HueLight> Vector of individual HueLight objects that were found on the server
+ * @param client 		Client holding the connection to the bridge
+ * @param path 			Path to request
+ * @param responseString Buffer the response is collected in
+ * @param options 		Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param limiter 		Rate limiter the request waits for
+ * @return Bool 		Success or failure of request
  */
-vector<HueLight> GetLightObjects(string url, int timeout, int elements) {
-	// For each light we found in the ALL request, request its specifics and return a vector of light objects
-	vector<HueLight> lights;
+bool MakePipelinedHTTPRequest(PipelinedHTTPClient &client, const string &path, ReceiveBuffer &responseString, const SimulationOptions &options, RateLimiter &limiter) {
+	limiter.Acquire();
+	return client.Get(path, responseString, chrono::steady_clock::now() + chrono::seconds(options.timeout));
+}
 
-    // Hardcode the retry information for individual light requests
-    int lightRetryAttempts = 3;
-    int lightSleep = 100;
 
-	for (int i = 1; i <= elements; i++) {
-  		string urlString = url + to_string(i);
-		string responseString;
+/**
+ * Fill a HueLight from the JSON object the server returns for a single light. The same shape is used both for
+ * the individual light request and for each entry of the "Query all" collection request.
+ *
+ * json library throws an error when there is illegal access, so the caller must be ready to catch:
+ *	"accessing an invalid index (i.e., an index greater than or equal to the array size) or the passed object key is non-existing, an exception is thrown." (https://nlohmann.github.io/json/features/element_access/checked_access/)
+ *
+ * @param j 		JSON object describing one light
+ * @param id 		ID of the light (the key it is stored under on the server)
+ * @return HueLight HueLight object parsed from the JSON
+ */
+HueLight ParseLightObject(const json &j, int id) {
+	HueLight light;
 
-		// printf("For debugging: \tURL: [%s]\n", urlString.c_str());
+	light.id = id;
+	light.name = j.at("name");
+	light.on = j.at("state").at("on");
+	SetLightBrightness(light, j.at("state").at("bri"));
+	light.isValid = true;
+	light.stale = false;
 
-		// Create char* url
-		char* url = createURLFromString(urlString);
+	return light;
+}
 
-		CURL *curl = CreateHTTPCurlHandle(url, timeout, &responseString);
+/**
+ * Parse the text of an individual light response with the given parser. The simd parser hands anything it does not
+ * handle itself to the schema parser, and the schema parser to the DOM parser. The stream parser only streams the
+ * "Query all" response, it parses the (small) light responses with the schema parser.
+ *
+ * @param parser 	"dom", "sax", "schema", "simd" or "stream" (see --jsonParser)
+ * @param begin 	Text of the response
+ * @param end 		End of the text
+ * @param id 		ID of the light
+ * @param light 	Set to the parsed light
+ * @param scanner 	Runs the simd parser
+ * @param fallbacks Counts the responses the schema or simd parser handed to a slower parser
+ * @return Bool 	False when the response could not be parsed
+ */
+bool ParseLightText(const string &parser, const char *begin, const char *end, int id, HueLight &light, SimdLightScanner &scanner, long &fallbacks) {
+	if (parser == "sax") {
+		// Straight from the text into the light, no json document in between
+		return SaxParseLight(begin, end, id, light);
+	}
 
-		if (!curl) {
-			// Unable to create CURL object
-			// cout<<"For debugging: Something went wrong creating curl object"<<endl;
-			curl_easy_cleanup(curl);
-			continue;
+	if (parser == "simd") {
+		if (scanner.ParseLight(begin, end, id, light)) {
+			return true;
 		}
+		fallbacks++;
+	}
 
-		if (!MakeHTTPRequest(curl, lightSleep, lightRetryAttempts)) {
-			// Something went wrong in the request, do not process responseString for JSON
-			// cout<<"For debugging: Something went wrong in the HTTP request"<<endl;
-			curl_easy_cleanup(curl);			
-			continue;
+	if (parser == "schema" || parser == "simd" || parser == "stream") {
+		if (LightSchemaParser(begin, end).ParseLight(id, light)) {
+			return true;
 		}
+		if (parser != "simd") fallbacks++;
+	}
 
-  		//cout<<"For debugging: \nResponse string: [[["<<responseString<<"]]]\n";
-
-	    if (responseString == "") {
-	    	//printf("There was no information for element with id = %d. It was not due to a failure on the server side. Assume light has gone offline. \n", i);
-	    	curl_easy_cleanup(curl);
-	    	continue;
-    	}
+	try {
+		json j = json::parse(begin, end);
+		//cout<<"For debugging: j: "<<j.dump(4)<<endl;
 
-  		// Validate the incoming JSON responseString --> make sure always have all fields correct
-		// json library throws an error when there is illegal access:
-		//	"accessing an invalid index (i.e., an index greater than or equal to the array size) or the passed object key is non-existing, an exception is thrown." (https://nlohmann.github.io/json/features/element_access/checked_access/)
-		try {
-			HueLight light;
-			json j = json::parse(responseString);
-			//cout<<"For debugging: j: "<<j.dump(4)<<endl;
-
-			light.id = i;
-			light.name = j.at("name");
-	  		light.on = j.at("state").at("on");
-			light.bri = j.at("state").at("bri");
-
-	  		// https://developers.meethue.com/develop/hue-api/lights-api/
-	  		// Note: Brightness of the light. This is a scale from the minimum brightness the light is capable of, 1, to the maximum capable brightness, 254.
-			int bri = light.bri;
-			if (bri > 254) bri = 254;
-			if (bri < 1) bri = 1;
-			light.brightness = (int) (100 * bri / 254);
-
-			// If no error has been thrown, add the light to the lights vector
-			lights.push_back(light);
-		} catch (...) {
-			printf("ERROR: Program is unable to parse JSON object for ID = %d.\n", i);
-			//printf("This is most likely due to invalid JSON format in response string resulting in json.exception.out_of_range error.\n");
-		}
+		light = ParseLightObject(j, id);
+	} catch (...) {
+		return false;
+	}
+	return true;
+}
 
-		// Perform necessary clean up with CURL handle
-		curl_easy_cleanup(curl);
+/**
+ * Write out what a parser made of a light response (for --verifyParser)
+ *
+ * @param parsed 	The response could be parsed
+ * @param light 	Light it was parsed into
+ * @return string 	Description to compare
+ */
+string DescribeParsedLight(bool parsed, const HueLight &light) {
+	if (!parsed) {
+		return "not a light";
 	}
+	return to_json(light).dump() + " bri " + to_string(light.bri);
+}
 
-    return lights;
+/**
+ * Write out what a parser makes of the text of a light response, to compare the parsers (see ParserVerifier)
+ *
+ * @param parser 	"dom", "sax", "schema", "simd" or "stream" (see --jsonParser)
+ * @param kernel 	Kernel the simd parser runs
+ * @param begin 	Text of the response
+ * @param end 		End of the text
+ * @param id 		ID of the light
+ * @return string 	Description to compare
+ */
+string LightParseOutcome(const string &parser, SimdLightScanner::Kernel kernel, const char *begin, const char *end, int id) {
+	HueLight light;
+	SimdLightScanner scanner;
+	long fallbacks = 0;
+
+	scanner.kernel = kernel;
+	bool parsed = ParseLightText(parser, begin, end, id, light, scanner, fallbacks);
+	return DescribeParsedLight(parsed, light);
 }
 
-// Configure the parser to accept the correct commandline arguments
-void configure_parser(cli::Parser& parser) {
-	parser.set_optional<int>("t", "timeout", 10, "Integer timeout is the maximum time in seconds that you allow the HTTP request operation to take");
-	parser.set_optional<int>("s", "samplesPerMinute", 60, "Integer samplesPerMinute is the number of HTTP requests in a minute. Default is 60 (1 request every second).");
-	parser.set_optional<int>("r", "retryRequests", 10, "Integer retry requests is the number of retries to connect to the server before failure (program ends)");
-	parser.set_optional<int>("p", "port", 80, "Integer port to connect to server on.");
-	parser.set_optional<std::string>("n", "hostname", "localhost", "Hostname of server to connect to."); // h is reserved for "help"
+/**
+ * Check the parser picked on the command line against the DOM parser on a light response and mutated copies of it.
+ *
+ * @param bridge 	Bridge the response was received from
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param responseString Response of the individual light request
+ * @param id 		ID of the light
+ */
+void VerifyLightParse(BridgeMonitor &bridge, const SimulationOptions &options, const ReceiveBuffer &responseString, int id) {
+	bridge.verifier.Verify(responseString.Begin(), responseString.End(), [&bridge, &options, id](const char *begin, const char *end, bool reference) {
+		return LightParseOutcome(reference ? "dom" : options.jsonParser, bridge.scanner.kernel, begin, end, id);
+	});
 }
 
+/**
+ * Turn the response of an individual light request into a HueLight. A response that is byte-identical to the last one for
+ * the same light is not parsed again, the light it was parsed into last time is used instead.
+ *
+ * @param responseString 	Response of the individual light request
+ * @param id 				ID of the light
+ * @param bridge 			Bridge the light belongs to (fingerprints of the last sample, parse counters)
+ * @param options 			Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param light 			Set to the parsed light
+ * @return Bool 			False when the response could not be parsed
+ */
+bool ParseLightResponse(const ReceiveBuffer &responseString, int id, BridgeMonitor &bridge, const SimulationOptions &options, HueLight &light) {
+	ResponseFingerprints &fingerprints = bridge.fingerprints;
+	uint64_t fingerprint = FingerprintResponse(responseString);
+
+	if (fingerprints.FindLight(id, fingerprint, light)) {
+		return true;
+	}
+
+	chrono::steady_clock::time_point parseStart = chrono::steady_clock::now();
+	long allocationsBefore = AllocationCount();
+
+	// Validate the incoming JSON responseString --> make sure always have all fields correct. Parsed in place from the receive buffer
+	bool parsed = ParseLightText(options.jsonParser, responseString.Begin(), responseString.End(), id, light, bridge.scanner, bridge.stats.parserFallbacks);
+
+	bridge.stats.lightsParsed++;
+	bridge.stats.lightParseNs += chrono::duration<double, nano>(chrono::steady_clock::now() - parseStart).count();
+	bridge.stats.lightParseAllocations += AllocationCount() - allocationsBefore;
+
+	if (options.verifyParser) {
+		VerifyLightParse(bridge, options, responseString, id);
+	}
+
+	if (!parsed) {
+		printf("ERROR: Program is unable to parse JSON object for ID = %d.\n", id);
+		//printf("This is most likely due to invalid JSON format in response string resulting in json.exception.out_of_range error.\n");
+		fingerprints.ForgetLight(id);
+		return false;
+	}
+
+	fingerprints.RememberLight(id, fingerprint, light);
+	return true;
+}
 
-//. Prints out changes.
 /**
- * Updates the currentLightsState vector to have active lights from latest request. 
- * This function also prints out the state changes and initial state of the application (lights).
+ * Index the state kept from the last sample by light ID for the lights of this sample (IDs 1 to elements), so
+ * FindKnownLight does not have to search it. Done once per sample, by PickLightsToRefresh.
  *
- * @param url 		String url to connect to
- * @param timeout 	Time in seconds before a timeout on the GET request.
+ * @param bridge 	Bridge being sampled
  * @param elements 	Number of elements found in the "Query all" GET request
- * @return vector<HueLight> Vector of individual HueLight objects that were found on the server
  */
-void ProcessJSONLightsResonse(vector<HueLight> &currentLightsState, int elements, string url, int timeout, int runCount) {
-	// For each light we find, we need to get its attributes 
-	vector<HueLight> lights = GetLightObjects(url, timeout, elements);
+void IndexKnownLights(BridgeMonitor &bridge, int elements) {
+	bridge.knownLights.assign(elements, -1);
 
-	// Do the following for the first request being made
-	if (runCount == 0) {
-		// Perform deep copy of vector
-	    copy(lights.begin(), lights.end(), back_inserter(currentLightsState)); 
-	    
-		//Print the json objects as dump
-		ordered_json output = to_json_vector(lights);
+	for (size_t i = 0; i < bridge.currentLightsState.size(); i++) {
+		int id = bridge.currentLightsState[i].id;
+		if (id >= 1 && id <= elements) {
+			bridge.knownLights[id - 1] = (int) i;
+		}
+	}
+}
+
+/**
+ * Find a light in the state kept from the last sample.
+ *
+ * @param bridge 	Bridge the light belongs to
+ * @param id 		ID of the light
+ * @return HueLight* 	The light, NULL when it is not known
+ */
+const HueLight* FindKnownLight(const BridgeMonitor &bridge, int id) {
+	if (id >= 1 && id <= (int) bridge.knownLights.size()) {
+		int index = bridge.knownLights[id - 1];
+		if (index < 0) {
+			return NULL;
+		}
+		if (index < (int) bridge.currentLightsState.size() && bridge.currentLightsState[index].id == id) {
+			return &bridge.currentLightsState[index];
+		}
+	}
+
+	// Not indexed, or the state changed since (an event stream event during the sample): search it
+	for (const HueLight &light : bridge.currentLightsState) {
+		if (light.id == id) {
+			return &light;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Keep the last known state of a light that is not requested this sample. PickLightsToRefresh requests every light that
+ * is not known, so it is normally found; one that is not is left out like a light whose request failed.
+ *
+ * @param bridge 	Bridge the light belongs to
+ * @param id 		ID of the light
+ * @param lights 	Lights found during this sample
+ */
+void KeepKnownLight(const BridgeMonitor &bridge, int id, vector<HueLight> &lights) {
+	const HueLight *known = FindKnownLight(bridge, id);
+	if (known) {
+		lights.push_back(*known);
+	}
+}
 
-		cout<<output.dump(4)<<endl;
+/**
+ * Pick the lights whose details are requested this sample and store the choice in bridge.refreshLights.
+ *
+ * With a refresh slice, only that many lights are requested per sample, taking turns through all of the IDs, so the cost
+ * of a sample stays the same however many lights the bridge has. The other lights keep their last known state. Lights that
+ * are not known yet are always requested; lights that are gone are caught by the "Query all" request every sample.
+ *
+ * @param bridge 	Bridge to sample
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param elements 	Number of elements found in the "Query all" GET request
+ */
+void PickLightsToRefresh(BridgeMonitor &bridge, const SimulationOptions &options, int elements) {
+	IndexKnownLights(bridge, elements);
 
+	if (options.refreshSlice <= 0 || options.refreshSlice >= elements) {
+		bridge.refreshLights.assign(elements, true);
 		return;
 	}
 
-	// Need to compare the newly retrieved lights to the currentLightsState and print the differences.
-	CompareAndUpdateLightStates(currentLightsState, lights);
+	bridge.refreshLights.assign(elements, false);
 
-	// cout<<"For debugging: "<<runCount<<": Current light vector\n"<<to_json_vector(currentLightsState).dump(4)<<endl;
+	for (int n = 0; n < options.refreshSlice; n++) {
+		if (bridge.refreshCursor >= elements) bridge.refreshCursor = 0;
+		bridge.refreshLights.at(bridge.refreshCursor++) = true;
+	}
+
+	for (int i = 0; i < elements; i++) {
+		if (!bridge.refreshLights.at(i) && bridge.knownLights.at(i) < 0) {
+			bridge.refreshLights.at(i) = true;
+		}
+	}
 }
 
 /**
- * Run the simulation.
+ * Point in time by which the light requests of the current sample have to be done: tickBudget percent of the sample
+ * interval after the sample started.
  *
- * This functions drives the program. It accepts as input the parameters retrieved as arguments (or defaults) and sets up 
- * the loop for the HTTP requests. It monitors the general connection to the server and requests "all" of the lights alive on it. It
- * will then pass the vector of lights to another function monitors. 
+ * @param bridge 	Bridge being sampled
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @return time_point 	Deadline of the light requests (time_point::max() when there is no budget)
+ */
+chrono::steady_clock::time_point SampleDeadline(const BridgeMonitor &bridge, const SimulationOptions &options) {
+	if (options.tickBudget <= 0) {
+		return chrono::steady_clock::time_point::max();
+	}
+	return bridge.scheduler.last + bridge.scheduler.interval * options.tickBudget / 100;
+}
+
+/**
+ * Handle a light that got no answer this sample, because its request failed or its circuit breaker is open: keep its last
+ * known state marked stale instead of dropping it, so one lost response does not report the light as removed and then
+ * rediscovered. A light that is not known yet is left out.
  *
+ * @param bridge 	Bridge being sampled
+ * @param id 		ID of the light
+ * @param lights 	Lights found during this sample
+ */
+void KeepFailedLight(const BridgeMonitor &bridge, int id, vector<HueLight> &lights) {
+	const HueLight *known = FindKnownLight(bridge, id);
+	if (known) {
+		HueLight light = *known;
+		light.stale = true;
+		lights.push_back(light);
+	}
+}
+
+/**
+ * Handle a light whose request was cut off by the sample budget: keep its last known state marked stale like a failed
+ * light, and remember that it held up the sample.
  *
- * @param hostname 		Hostname to connect to.
- * @param portNumber 	Port to connect to.
- * @param timeout 		Time in seconds before a timeout on the GET request.
- * @param sleep   		Time in microseconds bewteen each GET request.
- * @param retryAttempts Attemps to retry making a connection with the server before giving up. 
- * @return Integer for success or failure.
+ * @param bridge 	Bridge being sampled
+ * @param id 		ID of the light
+ * @param lights 	Lights found during this sample
  */
-int RunProgram(string hostname, int portNumber, int timeout, int sleep, int retryAttempts) {
-  	CURLcode res;
-	vector<HueLight> currentLightsState;
-	json j;
-    int requestsMade = 0;
-	int runCount = 0;
-	int elements = 0;
-    string responseString;
-    string urlString;
+void KeepStaleLight(BridgeMonitor &bridge, int id, vector<HueLight> &lights) {
+	bridge.stats.budgetLights[id]++;
+	KeepFailedLight(bridge, id, lights);
+}
 
-	urlString = "http://"+hostname+":"+to_string(portNumber)+"/api/newdeveloper/lights/";
-	char* url = createURLFromString(urlString);
-	CURL *curl = CreateHTTPCurlHandle(url, timeout, &responseString);
+/**
+ * Get the individual Light objects from the server given the number of lights the server has running.
+ *
+ * @param bridge 	Bridge to request the lights from
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param elements 	Number of elements found in the "Query all" GET request
+ * @return vector<HueLight> Vector of individual HueLight objects that were found on the server
+ */
+vector<HueLight> GetLightObjects(BridgeMonitor &bridge, const SimulationOptions &options, int elements) {
+	// For each light we found in the ALL request, request its specifics and return a vector of light objects
+	vector<HueLight> lights;
 
-	if (!curl) {
-		// Unable to create CURL object
-		curl_easy_cleanup(curl);
-		return 1;
-	}
+    // All of the lights live on the same host:port, so they share one set of pooled handles
+    string poolKey = ConnectionPool::KeyFromURL(bridge.urlString);
 
-	printf("Connecting to %s\n\n", urlString.c_str());
+    // Every light keeps its response buffer from the last sample
+    bridge.lightRequests.resize(elements);
+    PickLightsToRefresh(bridge, options, elements);
 
-	while (curl) {
-		// Clear the resonse string
-		responseString.clear();
+    chrono::steady_clock::time_point deadline = SampleDeadline(bridge, options);
+    bool overBudget = false;
 
-		// Attempt to make the HTTP request
-		if (!MakeHTTPRequest(curl, sleep, retryAttempts)) {
-			// Something went wrong in the request, do not process responseString for JSON
-			printf("\nUnable to establish connection to server. Exiting program.\n");
-			return 1;
+	for (int i = 1; i <= elements; i++) {
+		if (!bridge.refreshLights.at(i - 1)) {
+			// Not its turn this sample, keep what we know
+			KeepKnownLight(bridge, i, lights);
+			continue;
 		}
-    	
-    	// If there is no information to process in the response string, do not proceed
-	    if (responseString == "") {
-	    	continue;
-    	}
 
-		try {
-			// Attempt to parse the json
-			j= json::parse(responseString);
-		} catch (...) {
-			printf("ERROR: Program is unable to parse JSON object.\n");
-			//printf("This is most likely due to invalid JSON format in response string resulting in json.exception.out_of_range error.\n");
+  		string urlString = bridge.urlString + to_string(i);
+		ReceiveBuffer &responseString = bridge.lightRequests.at(i - 1).responseString;
+
+		responseString.Clear();
+
+		// The light failed recently and is waiting out its backoff, keep what we know like for a failed request
+		if (!bridge.breakers.Allow(urlString)) {
+			KeepFailedLight(bridge, i, lights);
 			continue;
 		}
 
-		elements = 0;
-		// Get the number of elements. TODO: There must be a better way to get the length of the json objects (i.e. for an iterable object)
-		for (auto it = j.begin(); it != j.end(); ++it)
-		{
-			//For debugging: cout<<"it "<<it.key()<<j.at(it.key())<<endl;
-			elements+=1;
+		if (chrono::steady_clock::now() >= deadline) {
+			// The sample is out of time, do not even start the request
+			KeepStaleLight(bridge, i, lights);
+			overBudget = true;
+			continue;
 		}
 
-		// Updates the currentLightsState vector to have active lights from latest request. Prints out changes.
-		ProcessJSONLightsResonse(currentLightsState, elements, urlString, timeout, runCount);	
+		// printf("For debugging: \tURL: [%s]\n", urlString.c_str());
 
-		runCount++;
-		
-		usleep(sleep);
-	}
+		CURL *curl = CreateHTTPCurlHandle(bridge, urlString, options, &responseString);
 
-    curl_easy_cleanup(curl);
-    
-    return 0;
-}
+		if (!curl) {
+			// Unable to create CURL object
+			// cout<<"For debugging: Something went wrong creating curl object"<<endl;
+			KeepFailedLight(bridge, i, lights);
+			continue;
+		}
 
-/*
-	Main function accepts paramters from the command line. the parameters indicate where the simulator is being run and request information.
-	It calls the driving function RunProgram to begin executing the grunt of the application.
-*/
-int main(int argc, char *argv[]) {
-	// Use cli::Parser to accept and sanitize the command line arguments
-	cli::Parser parser(argc, argv);
-	configure_parser(parser);
-	parser.run_and_exit_if_error();
+		if (deadline != chrono::steady_clock::time_point::max()) {
+			// Cut the request off when the sample runs out of time (0 would mean no timeout at all)
+			long remainingMs = (long) chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+			curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, max(1L, min(remainingMs, options.timeout * 1000L)));
+		}
+
+		if (!MakeHTTPRequest(curl, bridge.limiter)) {
+			bridge.pool.Release(poolKey, curl);
+
+			if (chrono::steady_clock::now() >= deadline) {
+				// Cut off by the sample budget, not a failure of the light
+				KeepStaleLight(bridge, i, lights);
+				overBudget = true;
+				continue;
+			}
+
+			// Something went wrong in the request, do not process responseString for JSON. The light keeps its last known
+			// state until a request gets through
+			// cout<<"For debugging: Something went wrong in the HTTP request"<<endl;
+			bridge.breakers.Failure(urlString);
+			KeepFailedLight(bridge, i, lights);
+			continue;
+		}
+
+		bridge.breakers.Success(urlString);
+		bridge.pool.RecordTransfer(curl, responseString.Size());
+		bridge.conditional.Finish(curl, urlString, responseString);
+
+		// The handle (and its connection) is free for the next light
+		bridge.pool.Release(poolKey, curl);
+
+  		//cout<<"For debugging: \nResponse string: [[["<<responseString<<"]]]\n";
+
+	    if (responseString.Empty()) {
+	    	//printf("There was no information for element with id = %d. It was not due to a failure on the server side. Assume light has gone offline. \n", i);
+	    	continue;
+    	}
+
+		HueLight light;
+
+		// If no error has been thrown, add the light to the lights vector
+		if (ParseLightResponse(responseString, i, bridge, options, light)) {
+			lights.push_back(light);
+		}
+	}
+
+	if (overBudget) {
+		bridge.stats.ticksOverBudget++;
+	}
+
+    return lights;
+}
+
+/**
+ * Get the individual Light objects from the server, with up to maxInFlight of the per-light requests running at the same time.
+ * Produces the same lights as GetLightObjects, but the time it takes approaches the slowest light instead of the sum of all of them.
+ *
+ * @param bridge 	Bridge to request the lights from (its fetcher runs the requests concurrently)
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param elements 	Number of elements found in the "Query all" GET request
+ * @return vector<HueLight> Vector of individual HueLight objects that were found on the server
+ */
+vector<HueLight> GetLightObjectsConcurrently(BridgeMonitor &bridge, const SimulationOptions &options, int elements) {
+	vector<HueLight> lights;
+	string poolKey = ConnectionPool::KeyFromURL(bridge.urlString);
+
+	// Sized up front, the handles write into the response strings of these requests (kept from the last sample)
+	vector<FetchRequest> &requests = bridge.lightRequests;
+	requests.resize(elements);
+	PickLightsToRefresh(bridge, options, elements);
+
+	for (int i = 1; i <= elements; i++) {
+		FetchRequest &request = requests.at(i - 1);
+		request.Reset();
+
+		// Requests without a handle are skipped by the fetcher
+		if (!bridge.refreshLights.at(i - 1) || !bridge.breakers.Allow(bridge.urlString + to_string(i))) {
+			continue;
+		}
+
+		request.curl = CreateHTTPCurlHandle(bridge, bridge.urlString + to_string(i), options, &request.responseString);
+	}
+
+	if (options.hedgeRate > 0) {
+		// A duplicate is requested from the same URL through the same pool. The fetcher keeps the callbacks after this
+		// sample, so nothing local is captured by reference
+		bridge.fetcher.SetHedging(options.hedgeRate / 100.0, [&bridge, &options](FetchRequest &request) {
+			char *url = NULL;
+			curl_easy_getinfo(request.curl, CURLINFO_EFFECTIVE_URL, &url);
+			return CreateHTTPCurlHandle(bridge, url ? string(url) : bridge.urlString, options, &request.hedgeResponse);
+		}, [&bridge, poolKey](CURL *curl) {
+			bridge.pool.Release(poolKey, curl);
+		});
+	}
+
+	bridge.fetcher.FetchAll(requests, SampleDeadline(bridge, options));
+	bool overBudget = false;
+
+	for (int i = 1; i <= elements; i++) {
+		FetchRequest &request = requests.at(i - 1);
+
+		if (!bridge.refreshLights.at(i - 1)) {
+			// Not its turn this sample, keep what we know
+			KeepKnownLight(bridge, i, lights);
+			continue;
+		}
+
+		if (!request.curl) {
+			// Waiting out its backoff (or no handle could be made), keep what we know like for a failed request
+			KeepFailedLight(bridge, i, lights);
+			continue;
+		}
+
+		if (request.cancelled) {
+			// Cut off by the sample budget, not a failure of the light
+			bridge.pool.Release(poolKey, request.curl);
+			KeepStaleLight(bridge, i, lights);
+			overBudget = true;
+			continue;
+		}
+
+		if (request.result == CURLE_OK) {
+			bridge.pool.RecordTransfer(request.curl, request.responseString.Size());
+			bridge.conditional.Finish(request.curl, bridge.urlString + to_string(i), request.responseString);
+			bridge.breakers.Success(bridge.urlString + to_string(i));
+		} else {
+			bridge.breakers.Failure(bridge.urlString + to_string(i));
+		}
+		bridge.pool.Release(poolKey, request.curl);
+
+		// Same handling as GetLightObjects: failed requests keep the last known state, empty responses are skipped
+		if (request.result != CURLE_OK) {
+			KeepFailedLight(bridge, i, lights);
+			continue;
+		}
+		if (request.responseString.Empty()) {
+			continue;
+		}
+
+		HueLight light;
+
+		if (ParseLightResponse(request.responseString, i, bridge, options, light)) {
+			lights.push_back(light);
+		}
+	}
+
+	if (overBudget) {
+		bridge.stats.ticksOverBudget++;
+	}
+
+	return lights;
+}
+
+/**
+ * Get the individual Light objects from the server with the built-in HTTP/1.1 client: all the per-light requests are written
+ * to one connection back to back (pipelining) and the responses are read in order. Produces the same lights as GetLightObjects.
+ *
+ * @param bridge 	Bridge to request the lights from (its pipelining client sends the requests)
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param elements 	Number of elements found in the "Query all" GET request
+ * @return vector<HueLight> Vector of individual HueLight objects that were found on the server
+ */
+vector<HueLight> GetLightObjectsPipelined(BridgeMonitor &bridge, const SimulationOptions &options, int elements) {
+	vector<HueLight> lights;
+
+	bridge.lightRequests.resize(elements);
+	PickLightsToRefresh(bridge, options, elements);
+
+	vector<PipelinedRequest> &batch = bridge.pipelinedRequests;
+	batch.clear();
+
+	for (int i = 1; i <= elements; i++) {
+		FetchRequest &request = bridge.lightRequests.at(i - 1);
+		request.Reset();
+
+		if (!bridge.refreshLights.at(i - 1) || !bridge.breakers.Allow(bridge.urlString + to_string(i))) {
+			continue;
+		}
+
+		batch.push_back(PipelinedRequest());
+		batch.back().path = bridge.lightsPath + to_string(i);
+		batch.back().responseString = &request.responseString;
+		// The client writes the request once the rate limiter lets it go, without holding up the responses
+		batch.back().notBefore = bridge.limiter.Reserve();
+	}
+
+	chrono::steady_clock::time_point budget = SampleDeadline(bridge, options);
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(options.timeout);
+	bridge.http.FetchAll(batch, min(budget, deadline));
+
+	bool overBudget = false;
+	size_t next = 0;
+
+	for (int i = 1; i <= elements; i++) {
+		if (!bridge.refreshLights.at(i - 1)) {
+			// Not its turn this sample, keep what we know
+			KeepKnownLight(bridge, i, lights);
+			continue;
+		}
+
+		// The batch holds the lights in order, minus the ones waiting out their backoff: those keep what we know
+		if (next == batch.size() || batch[next].path != bridge.lightsPath + to_string(i)) {
+			KeepFailedLight(bridge, i, lights);
+			continue;
+		}
+		PipelinedRequest &request = batch[next++];
+
+		if (!request.done) {
+			if (chrono::steady_clock::now() >= budget) {
+				// Cut off by the sample budget, not a failure of the light
+				KeepStaleLight(bridge, i, lights);
+				overBudget = true;
+				continue;
+			}
+
+			bridge.breakers.Failure(bridge.urlString + to_string(i));
+			KeepFailedLight(bridge, i, lights);
+			continue;
+		}
+
+		bridge.breakers.Success(bridge.urlString + to_string(i));
+
+		// Same handling as GetLightObjects: skip empty responses
+		if (request.responseString->Empty()) {
+			continue;
+		}
+
+		HueLight light;
+
+		if (ParseLightResponse(*request.responseString, i, bridge, options, light)) {
+			lights.push_back(light);
+		}
+	}
+
+	if (overBudget) {
+		bridge.stats.ticksOverBudget++;
+	}
+
+	return lights;
+}
+
+/**
+ * Build the HueLight objects straight from the "Query all" collection response. The collection already holds the name and
+ * state of every light keyed by its ID, so no per-light requests are needed (1 request per tick instead of N+1).
+ *
+ * @param j 		Parsed JSON of the "Query all" GET request
+ * @param invalidKeys When not NULL, set to the keys of the members that are not valid lights instead of printing them
+ * @return vector<HueLight> Vector of individual HueLight objects that were found on the server (sorted by ID)
+ */
+vector<HueLight> GetLightObjectsFromCollection(const json &j, vector<string> *invalidKeys = NULL) {
+	vector<HueLight> lights;
+
+	for (auto it = j.begin(); it != j.end(); ++it) {
+		int id = 0;
+
+		try {
+			id = stoi(it.key());
+			lights.push_back(ParseLightObject(it.value(), id));
+		} catch (...) {
+			if (invalidKeys) {
+				invalidKeys->push_back(it.key());
+			} else {
+				printf("ERROR: Program is unable to parse JSON object for ID = %s.\n", it.key().c_str());
+			}
+		}
+	}
+
+	// The collection is keyed by string ("1", "10", "2", ...), so put the lights back in ID order for printing
+	sort(lights.begin(), lights.end(), [](const HueLight &a, const HueLight &b) { return a.id < b.id; });
+
+	return lights;
+}
+
+/**
+ * Parse the text of a "Query all" response with the given parser: count its members and, when asked, build its lights.
+ * The simd parser hands anything it does not handle itself to the schema parser, and the schema parser to the DOM parser.
+ * So does the stream parser, which has parsed the text while it was received.
+ *
+ * @param parser 	"dom", "sax", "schema", "simd" or "stream" (see --jsonParser)
+ * @param begin 	Text of the response
+ * @param end 		End of the text
+ * @param elements 	Set to the number of members of the collection
+ * @param lights 	When not NULL, set to the lights of the collection (sorted by ID)
+ * @param invalidKeys When not NULL, set to the keys of the members that are not valid lights instead of printing them
+ * @param scanner 	Runs the simd parser
+ * @param streamer 	The stream parser that was fed the text (NULL when it was not received through it)
+ * @param fallbacks Counts the responses the schema, simd or stream parser handed to a slower parser
+ * @return Bool 	False when the response could not be parsed
+ */
+bool ParseCollectionText(const string &parser, const char *begin, const char *end, int &elements, vector<HueLight> *lights, vector<string> *invalidKeys, SimdLightScanner &scanner, StreamingLightParser *streamer, long &fallbacks) {
+	if (parser == "sax") {
+		return SaxParseCollection(begin, end, elements, lights, invalidKeys);
+	}
+
+	if (parser == "simd") {
+		if (scanner.ParseCollection(begin, end, elements, lights)) {
+			return true;
+		}
+		fallbacks++;
+	}
+
+	if (parser == "stream" && streamer) {
+		if (streamer->Finish(begin, end, elements, lights)) {
+			return true;
+		}
+		fallbacks++;
+	}
+
+	if (parser == "schema" || parser == "simd" || parser == "stream") {
+		if (LightSchemaParser(begin, end).ParseCollection(elements, lights)) {
+			return true;
+		}
+		if (parser == "schema" || (parser == "stream" && !streamer)) fallbacks++;
+	}
+
+	try {
+		json j = json::parse(begin, end);
+
+		elements = (int) j.size();
+		if (lights) {
+			*lights = GetLightObjectsFromCollection(j, invalidKeys);
+		}
+	} catch (...) {
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Write out what a parser makes of the text of a "Query all" response, to compare the parsers (see ParserVerifier). The
+ * stream parser is fed the text in pieces of varying size first, like a transfer arrives.
+ *
+ * @param parser 	"dom", "sax", "schema", "simd" or "stream" (see --jsonParser)
+ * @param kernel 	Kernel the simd parser runs
+ * @param begin 	Text of the response
+ * @param end 		End of the text
+ * @param keepLights Build the lights of the collection (snapshot mode), not only count them
+ * @return string 	Description to compare
+ */
+string CollectionParseOutcome(const string &parser, SimdLightScanner::Kernel kernel, const char *begin, const char *end, bool keepLights) {
+	int elements = 0;
+	vector<HueLight> lights;
+	vector<string> invalidKeys;
+	SimdLightScanner scanner;
+	StreamingLightParser streamer;
+	long fallbacks = 0;
+
+	scanner.kernel = kernel;
+	if (parser == "stream") {
+		size_t length = end - begin;
+		streamer.Reset(keepLights);
+		for (size_t received = 0; received < length;) {
+			received = min(length, received + 1 + (received * 7919 + 13) % 97);
+			streamer.Feed(begin, begin + received);
+		}
+	}
+
+	if (!ParseCollectionText(parser, begin, end, elements, keepLights ? &lights : NULL, &invalidKeys, scanner, &streamer, fallbacks)) {
+		return string("not JSON");
+	}
+
+	string outcome = to_string(elements) + " members";
+	for (const HueLight &light : lights) {
+		outcome += ", " + DescribeParsedLight(true, light);
+	}
+	for (const string &key : invalidKeys) {
+		outcome += ", invalid " + key;
+	}
+	return outcome;
+}
+
+/**
+ * Check the parser picked on the command line against the DOM parser on a "Query all" response and mutated copies of it.
+ *
+ * @param bridge 	Bridge the response was received from (in its responseString)
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param keepLights The lights of the collection are built (snapshot mode), not only counted
+ */
+void VerifyCollectionParse(BridgeMonitor &bridge, const SimulationOptions &options, bool keepLights) {
+	bridge.verifier.Verify(bridge.responseString.Begin(), bridge.responseString.End(), [&bridge, &options, keepLights](const char *begin, const char *end, bool reference) {
+		return CollectionParseOutcome(reference ? "dom" : options.jsonParser, bridge.scanner.kernel, begin, end, keepLights);
+	});
+}
+
+/**
+ * Parse the response of the "Query all" request with the parser picked on the command line: count its members and, in
+ * snapshot mode, build its lights. Nothing is printed for a light that is not valid when only counting.
+ *
+ * @param bridge 	Bridge the response was received from (in its responseString)
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param elements 	Set to the number of members of the collection
+ * @param lights 	When not NULL, set to the lights of the collection (sorted by ID)
+ * @return Bool 	False when the response could not be parsed
+ */
+bool ParseCollectionResponse(BridgeMonitor &bridge, const SimulationOptions &options, int &elements, vector<HueLight> *lights) {
+	chrono::steady_clock::time_point parseStart = chrono::steady_clock::now();
+	long allocationsBefore = AllocationCount();
+
+	// The built-in client does not stream the response through the stream parser
+	StreamingLightParser *streamer = options.pipeline ? NULL : &bridge.streamer;
+	bool parsed = ParseCollectionText(options.jsonParser, bridge.responseString.Begin(), bridge.responseString.End(), elements, lights, NULL, bridge.scanner, streamer, bridge.stats.parserFallbacks);
+
+	bridge.stats.collectionParseNs += chrono::duration<double, nano>(chrono::steady_clock::now() - parseStart).count();
+	bridge.stats.collectionParseAllocations += AllocationCount() - allocationsBefore;
+
+	if (options.verifyParser) {
+		VerifyCollectionParse(bridge, options, lights != NULL);
+	}
+
+	if (!parsed) {
+		printf("ERROR: Program is unable to parse JSON object.\n");
+		//printf("This is most likely due to invalid JSON format in response string resulting in json.exception.out_of_range error.\n");
+		bridge.fingerprints.ForgetCollection();
+		return false;
+	}
+
+	bridge.stats.collectionMembers += elements;
+	bridge.stats.collectionParseBytes += bridge.responseString.Size();
+	return true;
+}
+
+// Configure the parser to accept the correct commandline arguments
+void configure_parser(cli::Parser& parser) {
+	parser.set_optional<int>("t", "timeout", 10, "Integer timeout is the maximum time in seconds that you allow the HTTP request operation to take");
+	parser.set_optional<int>("s", "samplesPerMinute", 60, "Integer samplesPerMinute is the number of HTTP requests in a minute. Default is 60 (1 request every second).");
+	parser.set_optional<int>("r", "retryRequests", 10, "Integer retry requests is the number of samples in a row the server may fail before the program ends. Failed requests are retried on later samples with exponential backoff.");
+	parser.set_optional<int>("p", "port", 80, "Integer port to connect to server on.");
+	parser.set_optional<std::string>("u", "unixSocket", "", "Path of a Unix domain socket to connect to instead of --hostname/--port (they are still sent in the Host header). For a bridge emulator on the same host.");
+	parser.set_optional<std::string>("n", "hostname", "localhost", "Hostname of server to connect to."); // h is reserved for "help"
+	parser.set_optional<bool>("S", "snapshot", false, "Build the lights from the single \"Query all\" response instead of requesting each light individually.");
+	parser.set_optional<int>("m", "maxInFlight", 1, "Integer maximum number of individual light requests to have running at the same time. Default is 1 (one after another).");
+	parser.set_optional<bool>("e", "eventLoop", false, "Drive all requests, retries and samples from a single non-blocking event loop (epoll) instead of blocking requests.");
+	parser.set_optional<std::string>("f", "fleet", "", "Path of a fleet file listing one bridge per line as host[:port][/username]. Monitors all of them from this process instead of --hostname/--port.");
+	parser.set_optional<bool>("z", "compressed", false, "Ask the server for gzip/deflate compressed responses.");
+	parser.set_optional<std::string>("o", "overrun", "skip", "What to do when a sample runs past the start of the next one: \"skip\" the missed samples and stay on schedule, or \"catchup\" by taking them right away.");
+	parser.set_optional<int>("a", "minInterval", 0, "Integer shortest time in milliseconds between samples in adaptive polling mode.");
+	parser.set_optional<int>("A", "maxInterval", 0, "Integer longest time in milliseconds between samples. Turns on adaptive polling: the interval shrinks toward --minInterval while lights change and grows toward --maxInterval while they do not. Default is 0 (fixed interval).");
+	parser.set_optional<double>("q", "rateLimit", 0, "Maximum number of requests per second sent to a bridge (a real Hue bridge handles about 10). Requests over the limit wait in line. Default is 0 (no limit).");
+	parser.set_optional<int>("b", "burst", 1, "Integer number of requests that may go out back to back before --rateLimit applies.");
+	parser.set_optional<int>("R", "refreshSlice", 0, "Integer number of lights whose details are requested per sample, taking turns through all of them. The other lights keep their last known state. Default is 0 (all lights every sample).");
+	parser.set_optional<int>("T", "tickBudget", 0, "Integer percentage of the sample interval the light requests of a sample may take. Requests still outstanding are cancelled and their lights keep their last known state (marked stale). Default is 0 (no budget).");
+	parser.set_optional<int>("H", "hedgeRate", 0, "Integer percentage of the light requests that may be duplicated when they take longer than 95% of the requests so far (the first copy to finish is used). Needs --maxInFlight above 1, does not work with --eventLoop or --eventStream. Default is 0 (no hedging).");
+	parser.set_optional<bool>("w", "warmUp", false, "Resolve the hostname once (and pin the address) and open the connections before the first sample.");
+	parser.set_optional<bool>("P", "pipeline", false, "Send the requests through the built-in HTTP/1.1 client, pipelined on one connection, instead of libcurl.");
+	parser.set_optional<bool>("E", "eventStream", false, "Subscribe to the bridge's event stream and apply the changes it pushes. The samples (--samplesPerMinute) become periodic full resyncs that catch missed events. Runs in event loop mode.");
+	parser.set_optional<std::string>("j", "jsonParser", "dom", "How the responses are parsed: \"dom\" builds a json document and reads the lights from it, \"sax\" reads the lights straight out of the text without one (fewer allocations), \"schema\" is a parser written for the light objects that does not allocate and hands anything unusual to \"dom\", \"simd\" first indexes the structure of the text with vector instructions (for very large collections) and hands anything unusual to \"schema\", \"stream\" parses the \"Query all\" response with \"schema\" while it is still being received and hands anything unusual to \"schema\" once it is complete.");
+	parser.set_optional<std::string>("k", "simdKernel", "auto", "Instructions the first pass of --jsonParser simd uses: \"avx2\", \"sse4.2\", \"scalar\" or \"auto\" (the best the CPU runs).");
+	parser.set_optional<bool>("V", "verifyParser", false, "Check the --jsonParser against the DOM parser on every response and on mutated copies of it, printing every disagreement to stderr. For testing, it is slow.");
+	parser.set_optional<int>("i", "statsInterval", 0, "Integer number of samples between printing the performance counters (connection reuse, ...). Default is 0 (never).");
+}
+
+
+//. Prints out changes.
+/**
+ * Updates the currentLightsState vector to have active lights from latest request. 
+ * This function also prints out the state changes and initial state of the application (lights).
+ *
+ * @param currentLightsState 	Vector of HueLight objects that were found on the server last request
+ * @param lights 				Vector of HueLight objects that were found on the server in the most recent request (used up)
+ * @param runCount 				Number of requests processed so far (0 is the initial request)
+ * @param out 					Stream the lights and changes are printed to
+ * @param bridge 				Identifier of the bridge the lights belong to ("" when monitoring a single bridge)
+ * @return Integer 				Number of changes printed (0 for the initial request)
+ */
+int ProcessJSONLightsResonse(vector<HueLight> &currentLightsState, vector<HueLight> &lights, int runCount, ostream &out, const string &bridge) {
+	// Do the following for the first request being made
+	if (runCount == 0) {
+		// Perform deep copy of vector
+	    copy(lights.begin(), lights.end(), back_inserter(currentLightsState)); 
+	    
+		//Print the json objects as dump (the lights are not needed anymore)
+		ordered_json output = to_json_vector(std::move(lights));
+
+		if (!bridge.empty()) {
+			output = ordered_json{ {"bridge", bridge}, {"lights", output}};
+		}
+
+		out<<output.dump(4)<<endl;
+
+		return 0;
+	}
+
+	// Need to compare the newly retrieved lights to the currentLightsState and print the differences.
+	return CompareAndUpdateLightStates(currentLightsState, lights, out, bridge);
+
+	// cout<<"For debugging: "<<runCount<<": Current light vector\n"<<to_json_vector(currentLightsState).dump(4)<<endl;
+}
+
+/**
+ * Count the heap allocations comparing a sample's lights with the known ones made (ProcessJSONLightsResonse). The first
+ * sample, which only prints the lights, is left out.
+ *
+ * @param bridge 		Bridge the sample was taken of (its runCount not yet counting the sample)
+ * @param allocations 	Heap allocations made
+ */
+void CountLightStateUpdate(BridgeMonitor &bridge, long allocations) {
+	if (bridge.runCount == 0) {
+		return;
+	}
+	bridge.stats.lightStateUpdates++;
+	bridge.stats.lightStateUpdateAllocations += allocations;
+}
+
+/**
+ * Print the performance counters collected so far.
+ *
+ * @param bridge 	Bridge the counters were collected for
+ */
+void PrintStatistics(const BridgeMonitor &bridge) {
+	const SimulationStats &stats = bridge.stats;
+	const ConnectionPool &pool = bridge.pool;
+	long long ticks = stats.ticks > 0 ? stats.ticks : 1;
+	// libcurl and the pipelining client together
+	long requests = pool.requests + bridge.http.requests;
+	long connections = pool.newConnections + bridge.http.newConnections;
+
+	printf("\nStatistics after %ld samples:\n", stats.ticks);
+	printf("Average sample time (ms):\t%.2f\n", stats.ticks ? stats.totalTickMs / stats.ticks : 0.0);
+	printf("Slowest sample time (ms):\t%.2f\n", stats.maxTickMs);
+	printf("Sample time p50/p99 (ms):\t%.2f / %.2f\n", bridge.sampleTimes.Percentile(50), bridge.sampleTimes.Percentile(99));
+	printf("Time to first snapshot (ms):\t%.2f", stats.firstSnapshotMs);
+	if (bridge.warmedUp) printf(" (resolve %.2f, warm-up %.2f)", stats.resolveMs, stats.warmUpMs);
+	printf("\n");
+	if (stats.totalCpuMs > 0) {
+		printf("Average sample CPU time (ms):\t%.3f (%.1f us per request)\n", stats.totalCpuMs / ticks, requests ? 1000 * stats.totalCpuMs / requests : 0.0);
+	}
+	printf("Requests made:\t\t\t%ld\n", requests);
+	printf("Request rate:\t\t\t%.1f requests/s while sampling\n", stats.totalTickMs > 0 ? requests * 1000.0 / stats.totalTickMs : 0.0);
+	printf("Connections opened:\t\t%ld\n", connections);
+	printf("Connection reuse ratio:\t\t%.1f%%\n", 100.0 * ConnectionPool::ReuseRatio(requests, connections));
+	if (bridge.http.requests > 0) {
+		// Everything the pipelining client received, headers included
+		printf("Bytes per sample:\t\t%lld on the wire, %lld decoded\n", (pool.wireBytes + bridge.http.wireBytes) / ticks, (pool.decodedBytes + bridge.http.decodedBytes) / ticks);
+	} else {
+		printf("Body bytes per sample:\t\t%lld on the wire, %lld decoded\n", pool.wireBytes / ticks, pool.decodedBytes / ticks);
+	}
+	printf("Receive buffer allocations:\t%ld last sample, %ld in total\n", stats.lastSampleAllocations, stats.bufferAllocations);
+	if (stats.lightsParsed > 0) {
+		if (AllocationsCounted) {
+			printf("Light parsing:\t\t\t%.0f ns, %.1f allocations per light (%ld parsed)\n", stats.lightParseNs / stats.lightsParsed, (double) stats.lightParseAllocations / stats.lightsParsed, stats.lightsParsed);
+		} else {
+			printf("Light parsing:\t\t\t%.0f ns per light (%ld parsed)\n", stats.lightParseNs / stats.lightsParsed, stats.lightsParsed);
+		}
+	}
+	if (stats.collectionMembers > 0) {
+		double throughput = stats.collectionParseNs > 0 ? stats.collectionParseBytes * 1000.0 / stats.collectionParseNs : 0.0;
+		if (AllocationsCounted) {
+			printf("Collection parsing:\t\t%.0f ns, %.1f allocations per light (%ld parsed), %.0f MB/s\n", stats.collectionParseNs / stats.collectionMembers, (double) stats.collectionParseAllocations / stats.collectionMembers, stats.collectionMembers, throughput);
+		} else {
+			printf("Collection parsing:\t\t%.0f ns per light (%ld parsed), %.0f MB/s\n", stats.collectionParseNs / stats.collectionMembers, stats.collectionMembers, throughput);
+		}
+	}
+	if (bridge.scanner.scanNs > 0) {
+		// First pass only, the light extraction is in the parsing times above
+		printf("Structural scan (%s):\t%.0f MB/s\n", SimdLightScanner::KernelName(bridge.scanner.kernel), bridge.scanner.scannedBytes * 1000.0 / bridge.scanner.scanNs);
+	}
+	if (bridge.streamer.responses > 0) {
+		// Parsing left once the transfer was over is in the collection parsing time above
+		printf("Streaming parse:\t\t%.0f us per response while receiving, %.0f%% of the lights done before the last piece arrived\n", bridge.streamer.receiveNs / 1000 / bridge.streamer.transfers, 100.0 * bridge.streamer.lightsEarly / max(bridge.streamer.lightsParsed, 1L));
+	}
+	if (AllocationsCounted && stats.lightStateUpdates > 0) {
+		printf("Light state update:\t\t%.1f allocations per sample (%ld samples compared)\n", (double) stats.lightStateUpdateAllocations / stats.lightStateUpdates, stats.lightStateUpdates);
+	}
+	if (stats.parserFallbacks > 0) {
+		printf("Parser fallbacks:\t\t%ld responses handed to a slower parser\n", stats.parserFallbacks);
+	}
+	if (bridge.verifier.responses > 0) {
+		printf("Parser verification:\t\t%ld responses and %ld mutations checked, %ld disagreements\n", bridge.verifier.responses, bridge.verifier.mutations, bridge.verifier.mismatches);
+	}
+	printf("Unchanged responses skipped:\t%ld/%ld (%.1f%%)\n", bridge.fingerprints.hits, bridge.fingerprints.checks, 100 * bridge.fingerprints.HitRate());
+	printf("Not modified (304) responses:\t%ld/%ld (%ld body bytes saved)\n", bridge.conditional.notModified, bridge.conditional.requests, bridge.conditional.bytesSaved);
+	printf("Samples per minute:\t\t%.1f achieved, %.1f requested\n", bridge.scheduler.AchievedPerMinute(), bridge.scheduler.RequestedPerMinute());
+	printf("Start jitter (ms):\t\t%.2f average, %.2f worst\n", bridge.scheduler.AverageJitterMs(), bridge.scheduler.maxJitterMs);
+	printf("Samples skipped by overruns:\t%ld\n", bridge.scheduler.skipped);
+	printf("Samples over budget:\t\t%ld", stats.ticksOverBudget);
+	if (!stats.budgetLights.empty()) {
+		// The lights that held up the most samples first
+		vector<pair<long, int> > worst;
+		for (map<int, long>::const_iterator it = stats.budgetLights.begin(); it != stats.budgetLights.end(); ++it) {
+			worst.push_back(make_pair(-it->second, it->first));
+		}
+		sort(worst.begin(), worst.end());
+
+		printf(" (held up by light");
+		for (size_t i = 0; i < worst.size() && i < 5; i++) {
+			printf("%s %d x%ld", i ? "," : "", worst[i].second, -worst[i].first);
+		}
+		if (worst.size() > 5) printf(" and %d more", (int) worst.size() - 5);
+		printf(")");
+	}
+	printf("\n");
+	if (bridge.fetcher.hedges > 0 || bridge.fetcher.hedgeAfterMs > 0) {
+		printf("Hedged requests:\t\t%ld (%ld won), hedging after %.2f ms (p95)\n", bridge.fetcher.hedges, bridge.fetcher.hedgeWins, bridge.fetcher.hedgeAfterMs);
+	}
+	if (stats.streamConnects > 0) {
+		printf("Event stream:\t\t\t%ld events, %ld changes applied, %ld changes caught by resyncs, %ld connects\n", stats.streamEvents, stats.streamChanges, stats.changes - stats.streamChanges, stats.streamConnects);
+	}
+	printf("Circuit breakers:\t\t%d open, %ld transitions, %ld requests skipped\n", bridge.breakers.OpenCount(), bridge.breakers.transitions, bridge.breakers.skipped);
+	if (bridge.limiter.Enabled()) {
+		printf("Rate limiter queue wait (ms):\t%.2f average, %.2f worst (%ld/%ld requests waited)\n", bridge.limiter.AverageWaitMs(), bridge.limiter.maxWaitMs, bridge.limiter.delayed, bridge.limiter.requests);
+	}
+	printf("Changes detected:\t\t%ld (%.1f requests per change)\n", stats.changes, stats.changes ? (double) requests / stats.changes : 0.0);
+	printf("Detection latency (ms):\t\t%.1f average (estimated)\n\n", stats.changes ? stats.totalDetectionLatencyMs / stats.changes : 0.0);
+}
+
+/**
+ * Account for the changes a sample detected and, in adaptive polling mode, move the interval to the next sample.
+ *
+ * The detection latency of a change is estimated as half the time since the previous sample started (a change is equally
+ * likely to have happened at any point in between) plus the time the sample took.
+ *
+ * @param bridge 		Bridge that was sampled
+ * @param changes 		Changes the sample detected
+ * @param tickMs 		Time the sample took
+ * @param out 			Stream the new interval is printed to
+ */
+void RecordSampleChanges(BridgeMonitor &bridge, int changes, double tickMs, ostream &out) {
+	bridge.stats.changes += changes;
+	if (changes > 0) {
+		double sinceLastMs = chrono::duration<double, milli>(bridge.scheduler.last - bridge.scheduler.previous).count();
+		bridge.stats.totalDetectionLatencyMs += changes * (sinceLastMs / 2 + tickMs);
+	}
+
+	if (bridge.adaptive.Update(changes)) {
+		bridge.scheduler.SetInterval(bridge.adaptive.interval);
+		out<<"Polling interval is now "<<bridge.adaptive.interval / 1000<<" ms"<<(bridge.name.empty() ? "" : " on bridge " + bridge.name)<<endl;
+	}
+}
+
+/**
+ * Count how often the receive buffers of a bridge had to grow, in total and during the last sample. Once every buffer is as
+ * large as the responses it receives, a sample should not allocate any more.
+ *
+ * @param bridge 		Bridge that was sampled
+ */
+void RecordBufferAllocations(BridgeMonitor &bridge) {
+	long allocations = bridge.responseString.allocations;
+	for (const FetchRequest &request : bridge.lightRequests) {
+		allocations += request.responseString.allocations + request.hedgeResponse.allocations;
+	}
+
+	bridge.stats.lastSampleAllocations = allocations - bridge.stats.bufferAllocations;
+	bridge.stats.bufferAllocations = allocations;
+}
+
+/**
+ * Get a bridge ready before its first sample: resolve its hostname once and pin the address for every handle, then open as
+ * many kept-alive connections as the samples will use at once (by requesting the small /api/config), so the first
+ * sample does not have to pay for them.
+ *
+ * @param bridge 		Bridge to get ready
+ * @param options 		Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ */
+void PrepareBridge(BridgeMonitor &bridge, const SimulationOptions &options) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	// Nothing to resolve over a Unix domain socket
+	if (options.unixSocket.empty() && !bridge.pool.PinAddress(bridge.hostname, bridge.port)) {
+		fprintf(stderr, "Function PrepareBridge: unable to resolve %s\n", bridge.hostname.c_str());
+	}
+
+	chrono::steady_clock::time_point resolved = chrono::steady_clock::now();
+
+	if (options.pipeline) {
+		// The pipelining client resolves the hostname itself and sends everything on one connection
+		ReceiveBuffer config;
+		MakePipelinedHTTPRequest(bridge.http, "/api/config", config, options, bridge.limiter);
+
+		bridge.stats.warmUpMs = chrono::duration<double, milli>(chrono::steady_clock::now() - resolved).count();
+		bridge.warmedUp = true;
+		return;
+	}
+
+	string poolKey = ConnectionPool::KeyFromURL(bridge.urlString);
+	string configURL = "http://" + poolKey + "/api/config";
+	vector<FetchRequest> requests(options.maxInFlight > 1 ? options.maxInFlight : 1);
+
+	for (FetchRequest &request : requests) {
+		request.curl = CreateHTTPCurlHandle(bridge, configURL, options, &request.responseString);
+	}
+
+	bridge.fetcher.FetchAll(requests);
+
+	for (FetchRequest &request : requests) {
+		if (!request.curl) continue;
+
+		if (request.result == CURLE_OK) {
+			bridge.pool.RecordTransfer(request.curl, request.responseString.Size());
+		}
+		bridge.pool.Release(poolKey, request.curl);
+	}
+
+	bridge.stats.resolveMs = chrono::duration<double, milli>(resolved - start).count();
+	bridge.stats.warmUpMs = chrono::duration<double, milli>(chrono::steady_clock::now() - resolved).count();
+	bridge.warmedUp = true;
+}
+
+/**
+ * Take one sample of a bridge: request "all" of the lights alive on it, get their details and print the initial state
+ * or the changes since the last sample.
+ *
+ * @param bridge 		Bridge to sample
+ * @param options 		Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @param out 			Stream the lights and changes are printed to
+ * @return Bool 		False when the server could not be reached for retryAttempts samples in a row
+ */
+bool SampleBridge(BridgeMonitor &bridge, const SimulationOptions &options, ostream &out) {
+	int elements = 0;
+
+	chrono::steady_clock::time_point tickStart = chrono::steady_clock::now();
+	bridge.scheduler.Started(tickStart);
+
+	// CPU time of this thread only, so fleet workers do not count each other's samples
+	timespec cpuStart;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+
+	// The bridge failed recently and is waiting out its backoff, try again on a later sample
+	if (!bridge.breakers.Allow(bridge.urlString)) {
+		return true;
+	}
+
+	bool reached;
+
+	if (options.pipeline) {
+		reached = MakePipelinedHTTPRequest(bridge.http, bridge.lightsPath, bridge.responseString, options, bridge.limiter);
+	} else {
+		CURL *curl = CreateHTTPCurlHandle(bridge, bridge.urlString, options, &bridge.responseString);
+
+		if (!curl) {
+			// Unable to create CURL object
+			return false;
+		}
+		StreamCollectionResponse(bridge, curl, options);
+
+		// Clear the resonse string
+		bridge.responseString.Clear();
+
+		// Attempt to make the HTTP request
+		reached = MakeHTTPRequest(curl, bridge.limiter);
+
+		if (reached) {
+			bridge.pool.RecordTransfer(curl, bridge.responseString.Size());
+			bridge.conditional.Finish(curl, bridge.urlString, bridge.responseString);
+		}
+		bridge.pool.Release(ConnectionPool::KeyFromURL(bridge.urlString), curl);
+	}
+
+	if (reached) {
+		bridge.breakers.Success(bridge.urlString);
+	} else {
+		bridge.breakers.Failure(bridge.urlString);
+	}
+
+	if (!reached) {
+		// Something went wrong in the request, do not process responseString for JSON. Give up after retryAttempts samples in a row.
+		return bridge.breakers.Failures(bridge.urlString) < options.retryAttempts;
+	}
+	
+	// If there is no information to process in the response string, do not proceed
+    if (bridge.responseString.Empty()) {
+    	return true;
+	}
+
+	// Most samples the bridge returns exactly the same body as last time
+	bool collectionUnchanged = bridge.fingerprints.CollectionUnchanged(bridge.responseString);
+	bool changed = true;
+	vector<HueLight> lights;
+
+	bridge.fingerprints.sampleMisses = 0;
+
+	if (options.snapshot && collectionUnchanged && bridge.runCount > 0) {
+		// Same snapshot as last sample: nothing can have changed
+		changed = false;
+	} else if (!collectionUnchanged || options.snapshot) {
+		// Count the members and, in snapshot mode, get everything we need straight from the collection response
+		if (!ParseCollectionResponse(bridge, options, elements, options.snapshot ? &lights : NULL)) {
+			return true;
+		}
+		bridge.fingerprints.collectionElements = elements;
+	} else {
+		elements = bridge.fingerprints.collectionElements;
+	}
+
+	if (!options.snapshot) {
+		// For each light we find, we need to get its attributes 
+		if (options.pipeline) {
+			lights = GetLightObjectsPipelined(bridge, options, elements);
+		} else if (options.maxInFlight > 1) {
+			lights = GetLightObjectsConcurrently(bridge, options, elements);
+		} else {
+			lights = GetLightObjects(bridge, options, elements);
+		}
+
+		// Every response was the same as last sample and the same lights answered: nothing can have changed
+		if (collectionUnchanged && bridge.fingerprints.sampleMisses == 0 && bridge.runCount > 0 && SameLightsAsKnown(lights, bridge.currentLightsState)) {
+			changed = false;
+		}
+	}
+
+	int changes = 0;
+	if (changed) {
+		// Updates the currentLightsState vector to have active lights from latest request. Prints out changes.
+		long allocationsBefore = AllocationCount();
+		changes = ProcessJSONLightsResonse(bridge.currentLightsState, lights, bridge.runCount, out, bridge.name);
+		CountLightStateUpdate(bridge, AllocationCount() - allocationsBefore);
+	}
+
+	bridge.runCount++;
+	if (bridge.runCount == 1) {
+		bridge.stats.firstSnapshotMs = chrono::duration<double, milli>(chrono::steady_clock::now() - bridge.created).count();
+	}
+
+	double tickMs = chrono::duration<double, milli>(chrono::steady_clock::now() - tickStart).count();
+	bridge.stats.ticks++;
+	bridge.stats.totalTickMs += tickMs;
+	bridge.sampleTimes.Add(tickMs);
+	if (tickMs > bridge.stats.maxTickMs) bridge.stats.maxTickMs = tickMs;
+
+	timespec cpuEnd;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+	bridge.stats.totalCpuMs += (cpuEnd.tv_sec - cpuStart.tv_sec) * 1000.0 + (cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1000000.0;
+
+	RecordSampleChanges(bridge, changes, tickMs, out);
+	RecordBufferAllocations(bridge);
+
+	return true;
+}
+
+/**
+ * Run the simulation.
+ *
+ * This functions drives the program. It accepts as input the parameters retrieved as arguments (or defaults) and sets up 
+ * the loop for the HTTP requests. It monitors the general connection to the server and requests "all" of the lights alive on it. It
+ * will then pass the vector of lights to another function monitors. 
+ *
+ *
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @return Integer for success or failure.
+ */
+int RunProgram(const SimulationOptions &options) {
+	BridgeMonitor bridge("", options.hostname, options.port, "newdeveloper", options);
+
+	printf("Connecting to %s\n\n", bridge.urlString.c_str());
+
+	if (options.warmUp) {
+		PrepareBridge(bridge, options);
+	}
+
+	while (true) {
+		int samplesBefore = bridge.runCount;
+
+		// Wait for the next deadline instead of sleeping a fixed time, so the time a sample takes is not added to the interval
+		bridge.scheduler.WaitUntilDue();
+
+		if (!SampleBridge(bridge, options, cout)) {
+			printf("\nUnable to establish connection to server. Exiting program.\n");
+			return 1;
+		}
+
+		if (options.statsInterval > 0 && bridge.runCount != samplesBefore && bridge.runCount % options.statsInterval == 0) {
+			PrintStatistics(bridge);
+		}
+	}
+    
+    return 0;
+}
+
+/**
+ * Read the bridges of a fleet from a file. Every line describes one bridge as host[:port][/username], for example
+ * "10.0.0.12:8080/newdeveloper". The port defaults to 80 and the username to "newdeveloper". Empty lines and lines
+ * starting with '#' are skipped.
+ *
+ * @param fileName 	Path of the fleet file
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @return vector<unique_ptr<BridgeMonitor>> One monitor per bridge (empty if the file could not be read)
+ */
+vector<unique_ptr<BridgeMonitor> > ReadFleetFile(const string &fileName, const SimulationOptions &options) {
+	vector<unique_ptr<BridgeMonitor> > bridges;
+	ifstream file(fileName.c_str());
+	string line;
+
+	if (!file) {
+		printf("ERROR: Unable to open fleet file %s.\n", fileName.c_str());
+		return bridges;
+	}
+
+	while (getline(file, line)) {
+		// Trim the whitespace around the entry
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == string::npos || line[first] == '#') {
+			continue;
+		}
+		line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+
+		string hostname = line;
+		string username = "newdeveloper";
+		int port = 80;
+
+		size_t slash = hostname.find('/');
+		if (slash != string::npos) {
+			username = hostname.substr(slash + 1);
+			hostname = hostname.substr(0, slash);
+		}
+
+		size_t colon = hostname.find(':');
+		if (colon != string::npos) {
+			try {
+				port = stoi(hostname.substr(colon + 1));
+			} catch (...) {
+				printf("ERROR: Invalid port in fleet entry \"%s\". Skipping it.\n", line.c_str());
+				continue;
+			}
+			hostname = hostname.substr(0, colon);
+		}
+
+		bridges.push_back(unique_ptr<BridgeMonitor>(new BridgeMonitor(line, hostname, port, username, options)));
+	}
+
+	return bridges;
+}
+
+/**
+ * Run the simulation for a whole fleet of bridges from one process.
+ *
+ * Every bridge keeps its own light state and is sampled every sleep microseconds on a work stealing pool with one worker per
+ * core, so a slow bridge only holds up the worker sampling it. Changes are printed tagged with the bridge they came from. A
+ * bridge that cannot be reached is reported and tried again on its next sample instead of ending the program.
+ *
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @return Integer for success or failure.
+ */
+int RunFleetProgram(const SimulationOptions &options) {
+	vector<unique_ptr<BridgeMonitor> > bridges = ReadFleetFile(options.fleet, options);
+
+	if (bridges.empty()) {
+		printf("\nNo bridges to monitor in %s. Exiting program.\n", options.fleet.c_str());
+		return 1;
+	}
+
+	// One flag per bridge so a bridge is never sampled by two workers at once
+	unique_ptr<atomic<bool>[]> busy(new atomic<bool>[bridges.size()]);
+	atomic<long> samples(0);
+	mutex outputMutex;
+
+	for (size_t i = 0; i < bridges.size(); i++) {
+		busy[i] = false;
+	}
+
+	WorkStealingPool workers;
+
+	printf("Monitoring %zu bridges on %zu workers\n\n", bridges.size(), workers.Size());
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	long nextReport = options.statsInterval > 0 ? (long) options.statsInterval * bridges.size() : 0;
+
+	while (true) {
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		chrono::steady_clock::time_point wakeUp = now + chrono::milliseconds(10);
+
+		for (size_t i = 0; i < bridges.size(); i++) {
+			if (busy[i]) {
+				continue;
+			}
+
+			// Only read while the bridge is not busy, the worker sampling it moves the deadline
+			chrono::steady_clock::time_point due = bridges[i]->scheduler.Due();
+			if (due > now) {
+				if (due < wakeUp) wakeUp = due;
+				continue;
+			}
+
+			busy[i] = true;
+
+			BridgeMonitor *bridge = bridges.at(i).get();
+			atomic<bool> *bridgeBusy = &busy[i];
+
+			workers.Submit([bridge, bridgeBusy, &options, &samples, &outputMutex]() {
+				// Collect the output of the sample so it is printed in one piece
+				ostringstream out;
+				int samplesBefore = bridge->runCount;
+
+				if (options.warmUp && !bridge->warmedUp) {
+					PrepareBridge(*bridge, options);
+				}
+
+				if (!SampleBridge(*bridge, options, out)) {
+					out<<"Unable to establish connection to bridge "<<bridge->name<<". Trying again next sample."<<endl;
+				}
+
+				if (bridge->runCount != samplesBefore) {
+					samples++;
+				}
+
+				string output = out.str();
+				if (!output.empty()) {
+					lock_guard<mutex> lock(outputMutex);
+					cout<<output<<flush;
+				}
+
+				*bridgeBusy = false;
+			});
+		}
+
+		if (nextReport > 0 && samples >= nextReport) {
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+			lock_guard<mutex> lock(outputMutex);
+			printf("\nFleet statistics after %ld samples:\n", samples.load());
+			printf("Bridges monitored:\t\t%zu\n", bridges.size());
+			printf("Samples per second:\t\t%.2f\n", samples / seconds);
+			printf("Tasks stolen by workers:\t%ld\n\n", workers.Steals());
+			fflush(stdout);
+
+			nextReport += (long) options.statsInterval * bridges.size();
+		}
+
+		this_thread::sleep_until(wakeUp);
+	}
+
+	return 0;
+}
+
+struct EventLoopState;
+void ApplyStreamEvent(EventLoopState &state, const string &data);
+
+// State of the event loop mode that has to survive between callbacks
+struct EventLoopState {
+	SimulationOptions options;
+	BridgeMonitor bridge;		// Declared before the loop so the loop lets go of the handles before they are cleaned up
+	EventLoop loop;
+	int lightsOutstanding;		// Individual light requests that are not done yet
+	bool collectionUnchanged;	// The "Query all" response of the current sample is the same as last sample's
+	int exitCode;
+	chrono::steady_clock::time_point tickStart;
+	string streamURL;			// URL of the event stream (event stream mode)
+	CURL *stream;				// Handle of the event stream (NULL = not subscribed)
+	curl_slist *streamHeaders;
+	bool streamConnected;		// The event stream answered 200 on the current connection
+	long streamEventsBefore;	// Events received before the current connection
+	EventStreamParser events;
+
+	EventLoopState(const SimulationOptions &options) :
+		options(options),
+		bridge("", options.hostname, options.port, "newdeveloper", options),
+		lightsOutstanding(0),
+		collectionUnchanged(false),
+		exitCode(0),
+		streamURL("http://"+options.hostname+":"+to_string(options.port)+"/eventstream/clip/v2"),
+		stream(NULL),
+		streamHeaders(NULL),
+		streamConnected(false),
+		streamEventsBefore(0),
+		events([this](const string &data) { ApplyStreamEvent(*this, data); }) {
+	}
+
+	~EventLoopState() {
+		if (stream) {
+			loop.RemoveTransfer(stream);
+			curl_easy_cleanup(stream);
+		}
+		curl_slist_free_all(streamHeaders);
+	}
+};
+
+void StartEventLoopSample(EventLoopState &state);
+void FinishEventLoopLights(EventLoopState &state);
+
+/**
+ * Start a transfer in event loop mode once the rate limiter lets it go. A transfer that has to wait is started from a
+ * timer, so the loop keeps serving the others in the meantime. It is dropped if its sample was cut off by the sample budget
+ * before it got to start.
+ *
+ * @param state 	Event loop state
+ * @param curl 		Configured handle (see CreateHTTPCurlHandle)
+ * @param done 		Called with the handle and the result of the transfer
+ */
+void AddLimitedTransfer(EventLoopState &state, CURL *curl, EventLoop::TransferCallback done) {
+	chrono::steady_clock::time_point when = state.bridge.limiter.Reserve();
+
+	if (when <= chrono::steady_clock::now()) {
+		state.loop.AddTransfer(curl, done);
+	} else {
+		int runCount = state.bridge.runCount;
+		state.loop.AddTimer(when, [&state, curl, done, runCount]() {
+			if (state.bridge.runCount == runCount) {
+				state.loop.AddTransfer(curl, done);
+			}
+		});
+	}
+}
+
+/**
+ * Wrap up a sample in event loop mode: print the changes, update the counters and schedule the next sample.
+ * The next sample starts at its deadline on the bridge's schedule (see SampleScheduler).
+ *
+ * @param state 	Event loop state
+ * @param lights 	Lights found on the server during this sample
+ * @param changed 	False when every response was the same as last sample (nothing to compare)
+ */
+void FinishEventLoopSample(EventLoopState &state, vector<HueLight> &&lights, bool changed) {
+	int changes = 0;
+	if (changed) {
+		long allocationsBefore = AllocationCount();
+		changes = ProcessJSONLightsResonse(state.bridge.currentLightsState, lights, state.bridge.runCount, cout, "");
+		CountLightStateUpdate(state.bridge, AllocationCount() - allocationsBefore);
+	}
+	state.bridge.runCount++;
+	if (state.bridge.runCount == 1) {
+		state.bridge.stats.firstSnapshotMs = chrono::duration<double, milli>(chrono::steady_clock::now() - state.bridge.created).count();
+	}
+
+	double tickMs = chrono::duration<double, milli>(chrono::steady_clock::now() - state.tickStart).count();
+	state.bridge.stats.ticks++;
+	state.bridge.stats.totalTickMs += tickMs;
+	state.bridge.sampleTimes.Add(tickMs);
+	if (tickMs > state.bridge.stats.maxTickMs) state.bridge.stats.maxTickMs = tickMs;
+
+	RecordSampleChanges(state.bridge, changes, tickMs, cout);
+	RecordBufferAllocations(state.bridge);
+
+	if (state.options.statsInterval > 0 && state.bridge.runCount % state.options.statsInterval == 0) {
+		PrintStatistics(state.bridge);
+	}
+
+	state.loop.AddTimer(state.bridge.scheduler.Due(), [&state]() { StartEventLoopSample(state); });
+}
+
+/**
+ * Called when an individual light request is done. A failed request is recorded in the circuit breakers and tried again
+ * on a later sample (like GetLightObjects). Once every light is done the sample is finished.
+ *
+ * @param state 	Event loop state
+ * @param index 	Index of the request in state.bridge.lightRequests
+ * @param result 	Result of the transfer
+ */
+void OnEventLoopLightDone(EventLoopState &state, size_t index, CURLcode result) {
+	FetchRequest &request = state.bridge.lightRequests.at(index);
+	string urlString = state.bridge.urlString + to_string(index + 1);
+	request.result = result;
+
+	if (result != CURLE_OK) {
+		fprintf(stderr, "Function OnEventLoopLightDone: transfer failed for %s: %s\n", urlString.c_str(), curl_easy_strerror(result));
+		state.bridge.breakers.Failure(urlString);
+	} else {
+		state.bridge.pool.RecordTransfer(request.curl, request.responseString.Size());
+		state.bridge.conditional.Finish(request.curl, urlString, request.responseString);
+		state.bridge.breakers.Success(urlString);
+	}
+
+	request.done = true;
+	state.bridge.pool.Release(ConnectionPool::KeyFromURL(state.bridge.urlString), request.curl);
+
+	if (--state.lightsOutstanding > 0) {
+		return;
+	}
+
+	FinishEventLoopLights(state);
+}
+
+/**
+ * Called when every individual light request of the sample is done: parse the responses and finish the sample.
+ * Same handling as GetLightObjects: empty responses are skipped, failed lights keep their last known state (marked stale)
+ * and so do the lights that were not requested this sample.
+ *
+ * @param state 	Event loop state
+ */
+void FinishEventLoopLights(EventLoopState &state) {
+	vector<HueLight> lights;
+	for (size_t i = 0; i < state.bridge.lightRequests.size(); i++) {
+		FetchRequest &light = state.bridge.lightRequests.at(i);
+		int id = (int) i + 1;
+
+		if (!state.bridge.refreshLights.at(i)) {
+			KeepKnownLight(state.bridge, id, lights);
+			continue;
+		}
+
+		if (light.cancelled) {
+			KeepStaleLight(state.bridge, id, lights);
+			continue;
+		}
+
+		if (light.result != CURLE_OK) {
+			KeepFailedLight(state.bridge, id, lights);
+			continue;
+		}
+		if (light.responseString.Empty()) {
+			continue;
+		}
+
+		HueLight parsed;
+
+		if (ParseLightResponse(light.responseString, id, state.bridge, state.options, parsed)) {
+			lights.push_back(parsed);
+		}
+	}
+
+	// Every response was the same as last sample and the same lights answered: nothing can have changed
+	bool changed = !(state.collectionUnchanged && state.bridge.fingerprints.sampleMisses == 0 && state.bridge.runCount > 0 && SameLightsAsKnown(lights, state.bridge.currentLightsState));
+
+	FinishEventLoopSample(state, std::move(lights), changed);
+}
+
+/**
+ * Called when the sample budget runs out: cancel the light requests that are still outstanding and finish the sample with
+ * the lights that answered in time (the others keep their last known state, marked stale).
+ *
+ * @param state 	Event loop state
+ * @param runCount 	Sample the budget belongs to (nothing happens when that sample already finished)
+ */
+void CancelEventLoopLights(EventLoopState &state, int runCount) {
+	if (state.bridge.runCount != runCount || state.lightsOutstanding == 0) {
+		return;
+	}
+
+	string poolKey = ConnectionPool::KeyFromURL(state.bridge.urlString);
+
+	for (FetchRequest &request : state.bridge.lightRequests) {
+		if (!request.curl || request.done) continue;
+
+		state.loop.RemoveTransfer(request.curl);
+		state.bridge.pool.Release(poolKey, request.curl);
+		request.result = CURLE_OPERATION_TIMEDOUT;
+		request.cancelled = true;
+		request.done = true;
+	}
+
+	state.lightsOutstanding = 0;
+	state.bridge.stats.ticksOverBudget++;
+	FinishEventLoopLights(state);
+}
+
+/**
+ * Called when the "Query all" request is done. A failure is recorded in the circuit breakers and the request is tried
+ * again on a later sample; the program gives up after retryAttempts failed samples in a row (like RunProgram). On success either the snapshot is processed right away, or one request per light
+ * is started and the sample finishes once the last of them is done.
+ *
+ * @param state 	Event loop state
+ * @param curl 		Handle of the "Query all" request
+ * @param result 	Result of the transfer
+ */
+void OnEventLoopCollectionDone(EventLoopState &state, CURL *curl, CURLcode result) {
+	if (result != CURLE_OK) {
+		fprintf(stderr, "Function OnEventLoopCollectionDone: transfer failed: %s\n", curl_easy_strerror(result));
+		state.bridge.breakers.Failure(state.bridge.urlString);
+		state.bridge.pool.Release(ConnectionPool::KeyFromURL(state.bridge.urlString), curl);
+
+		if (state.bridge.breakers.Failures(state.bridge.urlString) < state.options.retryAttempts) {
+			state.loop.AddTimer(state.bridge.scheduler.Due(), [&state]() { StartEventLoopSample(state); });
+			return;
+		}
+
+		printf("\nUnable to establish connection to server at %s. Exiting program.\n", state.bridge.urlString.c_str());
+		state.exitCode = 1;
+		state.loop.Stop();
+		return;
+	}
+
+	state.bridge.pool.RecordTransfer(curl, state.bridge.responseString.Size());
+	state.bridge.conditional.Finish(curl, state.bridge.urlString, state.bridge.responseString);
+	state.bridge.breakers.Success(state.bridge.urlString);
+	state.bridge.pool.Release(ConnectionPool::KeyFromURL(state.bridge.urlString), curl);
+
+	// If there is no information to process in the response string, try again on the next sample
+	if (state.bridge.responseString.Empty()) {
+		state.loop.AddTimer(state.bridge.scheduler.Due(), [&state]() { StartEventLoopSample(state); });
+		return;
+	}
+
+	// Most samples the bridge returns exactly the same body as last time
+	state.collectionUnchanged = state.bridge.fingerprints.CollectionUnchanged(state.bridge.responseString);
+	state.bridge.fingerprints.sampleMisses = 0;
+
+	if (state.collectionUnchanged && state.options.snapshot && state.bridge.runCount > 0) {
+		// Same snapshot as last sample: nothing can have changed
+		FinishEventLoopSample(state, vector<HueLight>(), false);
+		return;
+	}
+
+	int elements = state.bridge.fingerprints.collectionElements;
+	vector<HueLight> lights;
+
+	if (!state.collectionUnchanged || state.options.snapshot) {
+		if (!ParseCollectionResponse(state.bridge, state.options, elements, state.options.snapshot ? &lights : NULL)) {
+			state.loop.AddTimer(state.bridge.scheduler.Due(), [&state]() { StartEventLoopSample(state); });
+			return;
+		}
+		state.bridge.fingerprints.collectionElements = elements;
+	}
+
+	if (state.options.snapshot) {
+		FinishEventLoopSample(state, std::move(lights), true);
+		return;
+	}
+
+	// Kept from the last sample so the response buffers keep their capacity
+	state.bridge.lightRequests.resize(elements);
+	state.lightsOutstanding = elements;
+	PickLightsToRefresh(state.bridge, state.options, elements);
+
+	if (elements == 0) {
+		FinishEventLoopSample(state, vector<HueLight>(), true);
+		return;
+	}
+
+	for (int i = 0; i < elements; i++) {
+		FetchRequest &request = state.bridge.lightRequests.at(i);
+		request.Reset();
+
+		if (!state.bridge.refreshLights.at(i)) {
+			// Not its turn this sample, nothing to wait for
+			request.done = true;
+			state.lightsOutstanding--;
+			continue;
+		}
+
+		if (!state.bridge.breakers.Allow(state.bridge.urlString + to_string(i + 1))) {
+			// Waiting out its backoff, kept like a failed request
+			request.result = CURLE_COULDNT_CONNECT;
+			request.done = true;
+			state.lightsOutstanding--;
+			continue;
+		}
+
+		request.curl = CreateHTTPCurlHandle(state.bridge, state.bridge.urlString + to_string(i + 1), state.options, &request.responseString);
+		request.attempts = 1;
+
+		if (!request.curl) {
+			// Unable to create CURL object, count the light as done
+			request.result = CURLE_FAILED_INIT;
+			request.done = true;
+			state.lightsOutstanding--;
+			continue;
+		}
+
+		size_t index = i;
+		AddLimitedTransfer(state, request.curl, [&state, index](CURL*, CURLcode result) { OnEventLoopLightDone(state, index, result); });
+	}
+
+	if (state.lightsOutstanding == 0) {
+		FinishEventLoopLights(state);
+	} else if (state.options.tickBudget > 0) {
+		int runCount = state.bridge.runCount;
+		state.loop.AddTimer(SampleDeadline(state.bridge, state.options), [&state, runCount]() { CancelEventLoopLights(state, runCount); });
+	}
+}
+
+/**
+ * Start a sample in event loop mode by sending the "Query all" request. Nothing blocks, the rest of the sample happens in
+ * the transfer callbacks.
+ *
+ * @param state 	Event loop state
+ */
+void StartEventLoopSample(EventLoopState &state) {
+	state.tickStart = chrono::steady_clock::now();
+	state.bridge.scheduler.Started(state.tickStart);
+	state.bridge.responseString.Clear();
+
+	if (!state.bridge.breakers.Allow(state.bridge.urlString)) {
+		// The bridge failed recently and is waiting out its backoff, try again on a later sample
+		state.loop.AddTimer(state.bridge.scheduler.Due(), [&state]() { StartEventLoopSample(state); });
+		return;
+	}
+
+	CURL *curl = CreateHTTPCurlHandle(state.bridge, state.bridge.urlString, state.options, &state.bridge.responseString);
+
+	if (!curl) {
+		// Unable to create CURL object
+		state.exitCode = 1;
+		state.loop.Stop();
+		return;
+	}
+	StreamCollectionResponse(state.bridge, curl, state.options);
+
+	AddLimitedTransfer(state, curl, [&state](CURL *curl, CURLcode result) { OnEventLoopCollectionDone(state, curl, result); });
+}
+
+/**
+ * Apply one event of the bridge's event stream to currentLightsState. The event carries the Hue v2 resources that changed;
+ * the light ones are matched to our lights through their "id_v1" ("/lights/<id>") and only the fields they carry are
+ * updated, in place. The changes are printed exactly as CompareAndUpdateLightStates prints them for a sample. A light that
+ * is added with its name is printed as discovered, any other change to a light we do not know yet is left for the next
+ * resync. The next resync always compares the lights again after an event changed them, so it corrects a wrong event.
+ *
+ * @param state 	Event loop state
+ * @param data 		Data of the event (a JSON array of events)
+ */
+void ApplyStreamEvent(EventLoopState &state, const string &data) {
+	BridgeMonitor &bridge = state.bridge;
+	bridge.stats.streamEvents++;
+
+	// Nothing to apply the changes to before the first sample
+	if (bridge.runCount == 0) {
+		return;
+	}
+
+	json j;
+	try {
+		j = json::parse(data);
+	} catch (...) {
+		printf("ERROR: Program is unable to parse event stream event.\n");
+		return;
+	}
+
+	if (!j.is_array()) {
+		j = json::array({j});
+	}
+
+	int changes = 0;
+
+	for (const json &event : j) {
+		if (!event.is_object() || !event.contains("data") || !event["data"].is_array()) continue;
+		string type = event.value("type", "");
+
+		for (const json &resource : event["data"]) {
+			if (!resource.is_object() || resource.value("type", "") != "light") continue;
+
+			string idV1 = resource.value("id_v1", "");
+			if (idV1.compare(0, 8, "/lights/") != 0) continue;
+			int id = atoi(idV1.c_str() + 8);
+
+			vector<HueLight> &known = bridge.currentLightsState;
+			vector<HueLight>::iterator light = known.begin();
+			while (light != known.end() && light->id != id) ++light;
+
+			if (type == "delete") {
+				if (light == known.end()) continue;
+				PrintRemovedLight(id, cout, bridge.name);
+				known.erase(light);
+				changes++;
+				continue;
+			}
+
+			if (light == known.end() && (type != "add" || !resource.contains("metadata"))) continue;
+
+			// Read every field the event carries before changing anything, so a broken one leaves the light as it was
+			bool hasOn = resource.contains("on"), on = false;
+			bool hasDimming = resource.contains("dimming");
+			bool hasName = resource.contains("metadata") && resource["metadata"].contains("name");
+			HueLight changed;
+			try {
+				if (hasOn) {
+					on = resource["on"].at("on");
+				}
+				if (hasDimming) {
+					// v2 reports the brightness in percent, same scale as the v1 "bri" is turned into
+					double percent = resource["dimming"].at("brightness");
+					SetLightBrightness(changed, (int) (percent * 254 / 100 + 0.5));
+				}
+				if (hasName) {
+					changed.name = resource["metadata"]["name"];
+				}
+			} catch (...) {
+				printf("ERROR: Program is unable to parse event stream event for ID = %d.\n", id);
+				continue;
+			}
+
+			if (light == known.end()) {
+				HueLight &added = changed;
+				added.id = id;
+				added.on = on;
+				if (!hasDimming) SetLightBrightness(added, 1);
+				added.isValid = true;
+				added.stale = false;
+
+				PrintDiscoveredLight(added, cout, bridge.name);
+				known.push_back(std::move(added));
+				changes++;
+				continue;
+			}
+
+			if (hasOn) {
+				changes += UpdateLightField(light->on, on, "on", id, cout, bridge.name);
+			}
+			if (hasDimming) {
+				light->bri = changed.bri;
+				changes += UpdateLightField(light->brightness, changed.brightness, "brightness", id, cout, bridge.name);
+			}
+			if (hasName) {
+				changes += UpdateLightField(light->name, changed.name, "name", id, cout, bridge.name);
+			}
+		}
+	}
+
+	bridge.stats.changes += changes;
+	bridge.stats.streamChanges += changes;
+
+	// The known lights no longer are what the last "Query all" response was compared into: the next resync must not skip
+	// the compare when that response comes back unchanged, or an event that was wrong, missed or out of order would stay
+	if (changes > 0) {
+		bridge.fingerprints.ForgetCollection();
+	}
+}
+
+/**
+ * Receives the bytes of the event stream. Anything but a 200 with the text/event-stream content type is not an event
+ * stream, so the transfer is aborted.
+ *
+ * This is the curl write callback (prototype) for the event stream handle.
+ */
+size_t EventStreamWrite(void *ptr, size_t size, size_t nmemb, EventLoopState *state) {
+	if (!state->streamConnected) {
+		long responseCode = 0;
+		char *contentType = NULL;
+		curl_easy_getinfo(state->stream, CURLINFO_RESPONSE_CODE, &responseCode);
+		curl_easy_getinfo(state->stream, CURLINFO_CONTENT_TYPE, &contentType);
+		if (responseCode != 200 || !contentType || strncasecmp(contentType, "text/event-stream", 17) != 0) {
+			fprintf(stderr, "Function EventStreamWrite: %s answered %ld (%s), not an event stream\n", state->streamURL.c_str(), responseCode, contentType ? contentType : "no content type");
+			return 0;
+		}
+
+		state->streamConnected = true;
+		state->bridge.breakers.Success(state->streamURL);
+	}
+
+	state->events.Feed((const char*) ptr, size * nmemb);
+	return size * nmemb;
+}
+
+void OnEventStreamDone(EventLoopState &state, CURLcode result);
+
+/**
+ * (Re)connect the event stream. The stream is one long-lived GET that the bridge keeps writing events to, so it has no
+ * timeout; a resumed stream asks for the events after the last one received (Last-Event-ID).
+ *
+ * @param state 	Event loop state
+ */
+void StartEventStream(EventLoopState &state) {
+	if (!state.bridge.breakers.Allow(state.streamURL)) {
+		state.loop.AddTimer(state.bridge.breakers.RetryAt(state.streamURL), [&state]() { StartEventStream(state); });
+		return;
+	}
+
+	if (!state.stream) {
+		// Not from the pool, the stream holds on to its connection
+		state.stream = curl_easy_init();
+		if (!state.stream) {
+			return;
+		}
+	}
+
+	curl_slist_free_all(state.streamHeaders);
+	state.streamHeaders = curl_slist_append(NULL, "Accept: text/event-stream");
+	state.streamHeaders = curl_slist_append(state.streamHeaders, "hue-application-key: newdeveloper");
+	if (!state.events.lastEventId.empty()) {
+		state.streamHeaders = curl_slist_append(state.streamHeaders, ("Last-Event-ID: " + state.events.lastEventId).c_str());
+	}
+
+	curl_easy_setopt(state.stream, CURLOPT_URL, state.streamURL.c_str());
+	curl_easy_setopt(state.stream, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
+	curl_easy_setopt(state.stream, CURLOPT_HTTPHEADER, state.streamHeaders);
+	curl_easy_setopt(state.stream, CURLOPT_CONNECTTIMEOUT, (long)state.options.timeout);
+	curl_easy_setopt(state.stream, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(state.stream, CURLOPT_UNIX_SOCKET_PATH, state.options.unixSocket.empty() ? NULL : state.options.unixSocket.c_str());
+	curl_easy_setopt(state.stream, CURLOPT_WRITEFUNCTION, EventStreamWrite);
+	curl_easy_setopt(state.stream, CURLOPT_WRITEDATA, &state);
+
+	state.events.Reset();
+	state.streamConnected = false;
+	state.streamEventsBefore = state.events.events;
+	state.bridge.stats.streamConnects++;
+	state.loop.AddTransfer(state.stream, [&state](CURL *, CURLcode result) { OnEventStreamDone(state, result); });
+}
+
+/**
+ * The event stream ended. A stream that delivered events is reconnected right away (once the rate limiter lets it go), one
+ * that failed or ended without an event waits out its backoff. The resyncs keep the lights up to date in the meantime.
+ *
+ * @param state 	Event loop state
+ * @param result 	Result of the transfer
+ */
+void OnEventStreamDone(EventLoopState &state, CURLcode result) {
+	if (state.streamConnected && state.events.events > state.streamEventsBefore) {
+		fprintf(stderr, "Function OnEventStreamDone: event stream ended (%s), reconnecting\n", curl_easy_strerror(result));
+		state.loop.AddTimer(state.bridge.limiter.Reserve(), [&state]() { StartEventStream(state); });
+		return;
+	}
+
+	if (result != CURLE_WRITE_ERROR) {
+		fprintf(stderr, "Function OnEventStreamDone: event stream failed: %s\n", curl_easy_strerror(result));
+	}
+	state.bridge.breakers.Failure(state.streamURL);
+	state.loop.AddTimer(max(state.bridge.breakers.RetryAt(state.streamURL), state.bridge.limiter.Reserve()), [&state]() { StartEventStream(state); });
+}
+
+/**
+ * Run the simulation from a single thread event loop.
+ *
+ * Same output as RunProgram, but no request blocks the program: the "Query all" request, the individual light requests,
+ * the retries and the time between samples are all driven by the EventLoop (epoll + timerfd + curl_multi_socket_action).
+ * The individual lights are requested at the same time, limited to maxInFlight connections when it is above 1.
+ *
+ * @param options 	Parameters retrieved as arguments (or defaults). See SimulationOptions.
+ * @return Integer for success or failure.
+ */
+int RunEventLoopProgram(const SimulationOptions &options) {
+	EventLoopState state(options);
+
+	if (options.maxInFlight > 1) {
+		// Plus the one the event stream holds
+		state.loop.SetMaxConnections(options.maxInFlight + (options.eventStream ? 1 : 0));
+	}
+
+	printf("Connecting to %s\n\n", state.bridge.urlString.c_str());
+
+	if (options.warmUp) {
+		// Before the loop runs, blocking is fine here
+		PrepareBridge(state.bridge, options);
+	}
+
+	if (options.eventStream) {
+		// Subscribed before the first sample, so no change falls in between
+		StartEventStream(state);
+	}
+
+	StartEventLoopSample(state);
+	state.loop.Run();
+
+	return state.exitCode;
+}
+
+/*
+	Main function accepts paramters from the command line. the parameters indicate where the simulator is being run and request information.
+	It calls the driving function RunProgram to begin executing the grunt of the application.
+*/
+// The tools (tools/ParserFuzzer.cpp, ...) include this file for its functions and bring their own main()
+#ifndef HUE_LIGHT_SIMULATOR_NO_MAIN
+int main(int argc, char *argv[]) {
+	// Must happen before any threads are started (fleet mode)
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	// Use cli::Parser to accept and sanitize the command line arguments
+	cli::Parser parser(argc, argv);
+	configure_parser(parser);
+	parser.run_and_exit_if_error();
 
 	// Retrieve command line arguments and sanitize input.
-	int timeout = parser.get<int>("t");
+	SimulationOptions options;
+	options.timeout = parser.get<int>("t");
 	int samplesPerMinute = parser.get<int>("s");
-	int retryAttempts = parser.get<int>("r");
-	int portNumber = parser.get<int>("p");
-	string hostname = parser.get<std::string>("n");
+	options.retryAttempts = parser.get<int>("r");
+	options.port = parser.get<int>("p");
+	options.hostname = parser.get<std::string>("n");
+	options.unixSocket = parser.get<std::string>("u");
+	options.snapshot = parser.get<bool>("S");
+	options.statsInterval = parser.get<int>("i");
+	options.maxInFlight = parser.get<int>("m");
+	options.eventLoop = parser.get<bool>("e");
+	options.fleet = parser.get<std::string>("f");
+	options.compressed = parser.get<bool>("z");
+	string overrun = parser.get<std::string>("o");
+
+	if (!options.fleet.empty() && !options.unixSocket.empty()) {
+		printf("\n--unixSocket does not work with --fleet.\n");
+		return 1;
+	}
+
+	if (!options.fleet.empty() && options.eventLoop) {
+		// The bridges of a fleet are sampled with blocking requests on the work stealing pool
+		printf("\n--eventLoop does not work with --fleet.\n");
+		return 1;
+	}
+
+	if (overrun != "skip" && overrun != "catchup") {
+		printf("\nUnknown overrun policy \"%s\", expected \"skip\" or \"catchup\".\n", overrun.c_str());
+		return 1;
+	}
+	options.catchUp = overrun == "catchup";
+	options.refreshSlice = parser.get<int>("R");
+	options.tickBudget = parser.get<int>("T");
+	options.hedgeRate = parser.get<int>("H");
+	options.warmUp = parser.get<bool>("w");
+	options.pipeline = parser.get<bool>("P");
+	options.eventStream = parser.get<bool>("E");
+	options.jsonParser = parser.get<std::string>("j");
+
+	options.verifyParser = parser.get<bool>("V");
+	options.simdKernel = parser.get<std::string>("k");
+
+	if (options.jsonParser != "dom" && options.jsonParser != "sax" && options.jsonParser != "schema" && options.jsonParser != "simd" && options.jsonParser != "stream") {
+		printf("\nUnknown JSON parser \"%s\", expected \"dom\", \"sax\", \"schema\", \"simd\" or \"stream\".\n", options.jsonParser.c_str());
+		return 1;
+	}
+
+	if (options.verifyParser && options.jsonParser == "dom") {
+		printf("\n--verifyParser checks the --jsonParser against \"dom\", pick \"sax\", \"schema\", \"simd\" or \"stream\".\n");
+		return 1;
+	}
+
+	SimdLightScanner::Kernel kernel;
+	if (!SimdLightScanner::KernelFromName(options.simdKernel, kernel)) {
+		printf("\nUnknown SIMD kernel \"%s\" or the CPU does not support it, expected \"avx2\", \"sse4.2\", \"scalar\" or \"auto\" (best here: %s).\n", options.simdKernel.c_str(), SimdLightScanner::KernelName(SimdLightScanner::BestKernel()));
+		return 1;
+	}
+	options.simdKernel = SimdLightScanner::KernelName(kernel);
+
+	if (options.pipeline && (options.eventLoop || options.compressed)) {
+		printf("\n--pipeline does not work with --eventLoop or --compressed.\n");
+		return 1;
+	}
+	options.rateLimit = parser.get<double>("q");
+	options.burst = parser.get<int>("b");
+	options.minInterval = parser.get<int>("a") * 1000;
+	options.maxInterval = parser.get<int>("A") * 1000;
+
+	if (options.maxInterval > 0 && (options.minInterval <= 0 || options.minInterval > options.maxInterval)) {
+		printf("\nAdaptive polling needs 0 < --minInterval <= --maxInterval.\n");
+		return 1;
+	}
+
+	if (options.eventStream) {
+		if (!options.fleet.empty() || options.pipeline || options.maxInterval > 0) {
+			printf("\n--eventStream does not work with --fleet, --pipeline or adaptive polling.\n");
+			return 1;
+		}
+		// The stream and the resyncs run in the event loop
+		options.eventLoop = true;
+	}
+
+	if (options.hedgeRate > 0 && options.eventLoop) {
+		// The event loop sends every light request once, it has no second copy to race
+		printf("\n--hedgeRate does not work with --eventLoop or --eventStream.\n");
+		return 1;
+	}
 
 	double samplesPerSecond = samplesPerMinute / 60.0;
 	// Sleep in microseconds between GET requests 
-	int sleep = (int) (1000000 / samplesPerSecond);
+	options.sleep = (int) (1000000 / samplesPerSecond);
 
 	printf("\nWelcome to the Philips Hue Console Application. Connecting to server using the following parameters:\n\n");
-	printf("Hostname:\t\t\t%s \n", hostname.c_str());
-	printf("Port number:\t\t\t%d\n", portNumber);
+	printf("Hostname:\t\t\t%s \n", options.hostname.c_str());
+	printf("Port number:\t\t\t%d\n", options.port);
+	if (!options.unixSocket.empty()) printf("Unix domain socket:\t\t%s\n", options.unixSocket.c_str());
 	printf("Samples per minute:\t\t%d\n", samplesPerMinute);
-	printf("Seconds between requests:\t%.2f\n", sleep/1000000.0);
-	printf("Retry attempts: \t\t%d\n", retryAttempts);
-	printf("Timeout (seconds):\t\t%d\n", timeout);
+	printf("Seconds between requests:\t%.2f\n", options.sleep/1000000.0);
+	printf("Retry attempts: \t\t%d\n", options.retryAttempts);
+	printf("Timeout (seconds):\t\t%d\n", options.timeout);
+	printf("Snapshot mode:\t\t\t%s\n", options.snapshot ? "on" : "off");
+	printf("Max requests in flight:\t\t%d\n", options.maxInFlight);
+	printf("Event loop mode:\t\t%s\n", options.eventLoop ? "on" : "off");
+	printf("Compressed responses:\t\t%s\n", options.compressed ? "on" : "off");
+	printf("Overrun policy:\t\t\t%s\n", overrun.c_str());
+	printf("Warm-up:\t\t\t%s\n", options.warmUp ? "on" : "off");
+	printf("Event stream:\t\t\t%s\n", options.eventStream ? "on (samples resync)" : "off");
+	printf("HTTP client:\t\t\t%s\n", options.pipeline ? "built-in (pipelined)" : "libcurl");
+	printf("JSON parser:\t\t\t%s", options.jsonParser.c_str());
+	if (options.jsonParser == "simd") printf(" (%s)", options.simdKernel.c_str());
+	printf("%s\n", options.verifyParser ? " (verified against dom)" : "");
+	if (options.hedgeRate > 0) printf("Hedged requests:\t\tup to %d%%\n", options.hedgeRate);
+	if (options.tickBudget > 0) printf("Sample budget:\t\t\t%d%% of the interval\n", options.tickBudget);
+	if (options.refreshSlice > 0) printf("Lights refreshed per sample:\t%d\n", options.refreshSlice);
+	if (options.rateLimit > 0) printf("Rate limit (requests/s):\t%.1f (burst %d)\n", options.rateLimit, options.burst);
+	if (options.maxInterval > 0) printf("Adaptive interval (ms):\t\t%d to %d\n", options.minInterval / 1000, options.maxInterval / 1000);
+	if (!options.fleet.empty()) printf("Fleet file:\t\t\t%s\n", options.fleet.c_str());
 	printf("\nGet ready! Begin simulation!\n\n");
 
-	return RunProgram(hostname, portNumber, timeout, sleep, retryAttempts);
-}
\ No newline at end of file
+	if (!options.fleet.empty()) {
+		return RunFleetProgram(options);
+	}
+
+	if (options.eventLoop) {
+		return RunEventLoopProgram(options);
+	}
+
+	return RunProgram(options);
+}
+#endif
@@ -0,0 +1,58 @@
+#ifndef ADAPTIVE_POLLING_H
+#define ADAPTIVE_POLLING_H
+
+/**
+ *
+ * Adapts the time between samples to how busy the lights are: every sample that detects a change halves the interval
+ * (down to the minimum) so the next changes are caught quickly, every quiet sample stretches it by half (up to the maximum)
+ * so an idle house costs few requests.
+*/
+class AdaptivePolling {
+public:
+	/**
+	 *
+	 * @param minMicroseconds 		Shortest interval
+	 * @param maxMicroseconds 		Longest interval (0 = adaptive polling off, the interval never changes)
+	 * @param startMicroseconds 	Interval to start from, clamped between the two
+	*/
+	AdaptivePolling(long minMicroseconds, long maxMicroseconds, long startMicroseconds) :
+		minInterval(minMicroseconds),
+		maxInterval(maxMicroseconds),
+		interval(Clamp(startMicroseconds)) {
+	}
+
+	bool Enabled() const {
+		return maxInterval > 0;
+	}
+
+	/**
+	 *
+	 * Adjust the interval after a sample.
+	 *
+	 * @param changes 	Changes the sample detected
+	 * @return Bool 	True when the interval changed
+	*/
+	bool Update(int changes) {
+		if (!Enabled()) return false;
+
+		long next = Clamp(changes > 0 ? interval / 2 : interval + interval / 2);
+		if (next == interval) return false;
+
+		interval = next;
+		return true;
+	}
+
+	long minInterval;
+	long maxInterval;
+	long interval;		// Current time between samples (microseconds)
+
+private:
+	long Clamp(long value) const {
+		if (!Enabled()) return value;
+		if (value < minInterval) return minInterval;
+		if (value > maxInterval) return maxInterval;
+		return value;
+	}
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+#include <new>
+#include <stdlib.h>
+
+/**
+ *
+ * Counts the heap allocations made through operator new on each thread, so the allocations of a piece of work can be
+ * measured as the difference of AllocationCount() before and after it. Only with HUE_LIGHT_SIMULATOR_COUNT_ALLOCATIONS
+ * defined (the benchmark build): it then replaces the global operator new / delete, so it must be included by exactly one
+ * translation unit. Without it the standard allocator is kept and AllocationCount() is always 0.
+*/
+#ifdef HUE_LIGHT_SIMULATOR_COUNT_ALLOCATIONS
+static const bool AllocationsCounted = true;
+
+static thread_local long threadAllocations = 0;
+
+inline long AllocationCount() {
+	return threadAllocations;
+}
+
+// Not inlined: the compiler would see malloc() and free() behind new and delete and warn that they do not match
+__attribute__((noinline)) void* operator new(std::size_t size) {
+	threadAllocations++;
+	void *memory = malloc(size ? size : 1);
+	if (!memory) throw std::bad_alloc();
+	return memory;
+}
+
+__attribute__((noinline)) void* operator new[](std::size_t size) {
+	threadAllocations++;
+	void *memory = malloc(size ? size : 1);
+	if (!memory) throw std::bad_alloc();
+	return memory;
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept {
+	free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void *memory) noexcept {
+	free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, std::size_t) noexcept {
+	free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void *memory, std::size_t) noexcept {
+	free(memory);
+}
+#else
+static const bool AllocationsCounted = false;
+
+inline long AllocationCount() {
+	return 0;
+}
+#endif
+
+#endif
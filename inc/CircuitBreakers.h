@@ -0,0 +1,160 @@
+#ifndef CIRCUIT_BREAKERS_H
+#define CIRCUIT_BREAKERS_H
+#include <map>
+#include <string>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+
+/**
+ *
+ * Retry state per endpoint (URL), so a failing request is retried on a later sample instead of blocking the current one.
+ *
+ * Every failure makes the endpoint wait before its next attempt. The wait doubles with every failure in a row, up to a
+ * maximum, and is jittered so endpoints that failed together do not retry together. After failureThreshold failures in a
+ * row the breaker of the endpoint opens. Once its wait is over, one attempt (half-open) decides whether it closes again or
+ * stays open with a longer wait. Requests to an endpoint that is waiting are skipped right away.
+ *
+ * Every state change is printed to stderr, so endpoints that keep flapping are easy to spot.
+*/
+class CircuitBreakers {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	enum State { Closed, Open, HalfOpen };
+
+	/**
+	 *
+	 * @param failureThreshold 	Failures in a row that open the breaker of an endpoint
+	 * @param baseBackoffMs 	Wait after the first failure
+	 * @param maxBackoffMs 		Longest wait
+	*/
+	CircuitBreakers(int failureThreshold, long baseBackoffMs, long maxBackoffMs) :
+		failureThreshold(failureThreshold < 1 ? 1 : failureThreshold),
+		baseBackoffMs(baseBackoffMs),
+		maxBackoffMs(maxBackoffMs),
+		transitions(0),
+		skipped(0),
+		random(std::random_device()()) {
+	}
+
+	/**
+	 *
+	 * Check whether a request to the endpoint may be made now.
+	 *
+	 * @return Bool 	False while the endpoint is waiting out its backoff (the request should be skipped)
+	*/
+	bool Allow(const std::string &endpoint) {
+		std::map<std::string, Breaker>::iterator it = breakers.find(endpoint);
+		if (it == breakers.end()) {
+			return true;
+		}
+
+		Breaker &breaker = it->second;
+		if (Clock::now() < breaker.retryAt) {
+			skipped++;
+			return false;
+		}
+
+		if (breaker.state == Open) {
+			Transition(endpoint, breaker, HalfOpen);
+		}
+		return true;
+	}
+
+	// Record a successful request to the endpoint
+	void Success(const std::string &endpoint) {
+		std::map<std::string, Breaker>::iterator it = breakers.find(endpoint);
+		if (it == breakers.end()) {
+			return;
+		}
+
+		if (it->second.state != Closed) {
+			Transition(endpoint, it->second, Closed);
+		}
+		breakers.erase(it);
+	}
+
+	// Record a failed request to the endpoint and start its backoff
+	void Failure(const std::string &endpoint) {
+		Breaker &breaker = breakers[endpoint];
+		breaker.failures++;
+
+		double backoffMs = baseBackoffMs;
+		for (int i = 1; i < breaker.failures && backoffMs < maxBackoffMs; i++) {
+			backoffMs *= 2;
+		}
+		if (backoffMs > maxBackoffMs) backoffMs = maxBackoffMs;
+
+		// Wait somewhere between half and all of the backoff
+		backoffMs *= std::uniform_real_distribution<double>(0.5, 1.0)(random);
+		breaker.retryAt = Clock::now() + std::chrono::microseconds((long long) (backoffMs * 1000));
+
+		if (breaker.state == HalfOpen || (breaker.state == Closed && breaker.failures >= failureThreshold)) {
+			Transition(endpoint, breaker, Open);
+		}
+	}
+
+	// Failures in a row of the endpoint (0 when its last request succeeded)
+	int Failures(const std::string &endpoint) const {
+		std::map<std::string, Breaker>::const_iterator it = breakers.find(endpoint);
+		return it == breakers.end() ? 0 : it->second.failures;
+	}
+
+	// Earliest time the next request to the endpoint is allowed (now when it is not waiting)
+	Clock::time_point RetryAt(const std::string &endpoint) const {
+		std::map<std::string, Breaker>::const_iterator it = breakers.find(endpoint);
+		return it == breakers.end() ? Clock::now() : it->second.retryAt;
+	}
+
+	// Number of endpoints whose breaker is not closed
+	int OpenCount() const {
+		int count = 0;
+		for (std::map<std::string, Breaker>::const_iterator it = breakers.begin(); it != breakers.end(); ++it) {
+			if (it->second.state != Closed) count++;
+		}
+		return count;
+	}
+
+	int failureThreshold;
+	long baseBackoffMs;
+	long maxBackoffMs;
+
+	long transitions;	// State changes of all breakers
+	long skipped;		// Requests skipped because their endpoint was waiting
+
+private:
+	struct Breaker {
+		State state;
+		int failures;				// Failures in a row
+		Clock::time_point retryAt;	// No attempts before this point in time
+
+		Breaker() : state(Closed), failures(0) {}
+	};
+
+	static const char* StateName(State state) {
+		switch (state) {
+			case Open: return "open";
+			case HalfOpen: return "half-open";
+			default: return "closed";
+		}
+	}
+
+	void Transition(const std::string &endpoint, Breaker &breaker, State state) {
+		if (state == Open) {
+			long retryInMs = (long) std::chrono::duration_cast<std::chrono::milliseconds>(breaker.retryAt - Clock::now()).count();
+			fprintf(stderr, "Circuit breaker for %s: %s -> open after %d failures in a row, next attempt in %ld ms\n",
+				endpoint.c_str(), StateName(breaker.state), breaker.failures, retryInMs);
+		} else {
+			fprintf(stderr, "Circuit breaker for %s: %s -> %s\n", endpoint.c_str(), StateName(breaker.state), StateName(state));
+		}
+
+		breaker.state = state;
+		transitions++;
+	}
+
+	std::map<std::string, Breaker> breakers;	// Endpoints that failed since their last success
+	std::mt19937 random;
+};
+
+#endif
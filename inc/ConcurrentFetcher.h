@@ -0,0 +1,370 @@
+#ifndef CONCURRENT_FETCHER_H
+#define CONCURRENT_FETCHER_H
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <stdio.h>
+#include <curl/curl.h>
+#include "./RateLimiter.h"
+#include "./LatencyWindow.h"
+#include "./ReceiveBuffer.h"
+
+// Describes one GET request issued through the ConcurrentFetcher
+struct FetchRequest {
+	CURL *curl;					// Configured handle to perform the request on (see CreateHTTPCurlHandle)
+	ReceiveBuffer responseString;	// The handle's write target, the response is collected here
+	CURLcode result;			// Result of the last attempt
+	int attempts;				// Number of attempts made
+	bool done;					// The request finished (successfully or after running out of attempts)
+	bool cancelled;				// The request was still outstanding when the deadline passed
+	CURL *hedge;				// Duplicate of the request racing it (NULL = not hedged)
+	ReceiveBuffer hedgeResponse;	// The duplicate's write target
+	bool primaryFailed;			// The request itself failed while its duplicate is still running
+	RateLimiter::Clock::time_point started;	// When the current attempt started
+
+	FetchRequest() : curl(NULL), result(CURLE_OK), attempts(0), done(false), cancelled(false), hedge(NULL), primaryFailed(false) {}
+
+	// Get ready to be issued again. The response string keeps its capacity.
+	void Reset() {
+		curl = NULL;
+		responseString.Clear();
+		result = CURLE_OK;
+		attempts = 0;
+		done = false;
+		cancelled = false;
+		hedge = NULL;
+		hedgeResponse.Clear();
+		primaryFailed = false;
+	}
+};
+
+/**
+ *
+ * Runs a batch of GET requests at the same time through the curl multi interface.
+ *
+ * At most maxInFlight requests are on the wire at once, the rest wait for a slot. A failed request is put back in line
+ * until it has been attempted retryAttempts times. Because the requests overlap, the time to finish a batch approaches the
+ * slowest single request instead of the sum of all of them. With a rate limiter set, a request only starts once the limiter
+ * lets it go; the fetcher keeps serving the requests in flight while it waits.
+ *
+ * With hedging on, a request that takes longer than the 95th percentile of the latencies seen so far gets a duplicate in a
+ * free slot, and whichever copy finishes first is used. At most hedgeRate of the requests started are hedged.
+*/
+class ConcurrentFetcher {
+public:
+	typedef std::function<CURL*(FetchRequest&)> HedgeFactory;
+	typedef std::function<void(CURL*)> HedgeRelease;
+
+	ConcurrentFetcher(int maxInFlight, int retryAttempts) :
+		hedges(0),
+		hedgeWins(0),
+		hedgeAfterMs(0),
+		maxInFlight(maxInFlight < 1 ? 1 : maxInFlight),
+		retryAttempts(retryAttempts < 1 ? 1 : retryAttempts),
+		limiter(NULL),
+		reserved(false),
+		hedgeRate(0),
+		latencies(200),
+		started(0) {
+		multi = curl_multi_init();
+		curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)this->maxInFlight);
+		// By default the connection cache shrinks with the number of handles added, which would close the kept-alive
+		// connections as the last requests of a batch finish. Keep one per slot (plus the collection request).
+		curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)this->maxInFlight + 1);
+	}
+
+	~ConcurrentFetcher() {
+		curl_multi_cleanup(multi);
+	}
+
+	// Pace the requests through a rate limiter (NULL = start them as soon as there is a free slot)
+	void SetRateLimiter(RateLimiter *rateLimiter) {
+		limiter = rateLimiter;
+	}
+
+	/**
+	 *
+	 * Turn hedging on (or off with a rate of 0).
+	 *
+	 * @param maxHedgeRate 	Largest fraction of the requests started that may be hedged
+	 * @param create 		Creates a handle for the same URL as the request that writes into its hedgeResponse
+	 * @param release 		Hands back a handle created for a duplicate (or the request's own handle when the duplicate won)
+	*/
+	void SetHedging(double maxHedgeRate, HedgeFactory create, HedgeRelease release) {
+		hedgeRate = maxHedgeRate;
+		createHedge = create;
+		releaseHedge = release;
+	}
+
+	/**
+	 *
+	 * Perform all of the requests and return once every one of them is done. Requests without a handle are skipped.
+	 * Requests that are still outstanding when the deadline passes are cancelled (result CURLE_OPERATION_TIMEDOUT).
+	 *
+	 * @param requests 	Requests to perform. The vector must not be resized while the fetch is running.
+	 * @param deadline 	Point in time by which every request has to be done
+	*/
+	void FetchAll(std::vector<FetchRequest> &requests, RateLimiter::Clock::time_point deadline = RateLimiter::Clock::time_point::max()) {
+		size_t next = 0;
+		int inFlight = 0;
+		int running = 0;
+
+		// Requests that failed and are waiting for another attempt
+		std::vector<FetchRequest*> retries;
+
+		// Hedge once a request takes longer than 95% of the requests seen so far (0 = not enough seen yet)
+		hedgeAfterMs = (hedgeRate > 0 && latencies.Count() >= 20) ? latencies.Percentile(95) : 0;
+
+		while (true) {
+			if (RateLimiter::Clock::now() >= deadline) {
+				CancelOutstanding(requests);
+				break;
+			}
+
+			// Set when the next request has to wait for the rate limiter
+			bool waiting = false;
+
+			// Fill the free slots, retries first so they do not wait behind the whole batch
+			while (inFlight < maxInFlight && !retries.empty()) {
+				if (!Admit()) {
+					waiting = true;
+					break;
+				}
+				Start(retries.back());
+				retries.pop_back();
+				inFlight++;
+			}
+			while (!waiting && inFlight < maxInFlight && next < requests.size()) {
+				FetchRequest &request = requests.at(next);
+
+				if (!request.curl) {
+					request.done = true;
+					next++;
+					continue;
+				}
+
+				if (!Admit()) {
+					waiting = true;
+					break;
+				}
+
+				next++;
+				Start(&request);
+				inFlight++;
+			}
+
+			if (inFlight == 0 && !waiting) {
+				break;
+			}
+
+			// Duplicate the slow requests in the slots the batch leaves free
+			RateLimiter::Clock::time_point nextHedge = RateLimiter::Clock::time_point::max();
+			if (!waiting && hedgeAfterMs > 0) {
+				RateLimiter::Clock::duration hedgeAfter = std::chrono::duration_cast<RateLimiter::Clock::duration>(std::chrono::duration<double, std::milli>(hedgeAfterMs));
+				RateLimiter::Clock::time_point now = RateLimiter::Clock::now();
+
+				for (size_t i = 0; i < next && inFlight < maxInFlight; i++) {
+					FetchRequest &request = requests.at(i);
+
+					if (!request.curl || request.done || request.hedge || std::find(retries.begin(), retries.end(), &request) != retries.end()) {
+						continue;
+					}
+
+					if (now < request.started + hedgeAfter) {
+						nextHedge = std::min(nextHedge, request.started + hedgeAfter);
+						continue;
+					}
+
+					if (hedges + 1 > hedgeRate * started) {
+						break;
+					}
+
+					if (!Admit()) {
+						waiting = true;
+						break;
+					}
+
+					if (StartHedge(&request)) {
+						inFlight++;
+					}
+				}
+			}
+
+			curl_multi_perform(multi, &running);
+
+			CURLMsg *msg;
+			int msgsLeft;
+			while ((msg = curl_multi_info_read(multi, &msgsLeft))) {
+				if (msg->msg != CURLMSG_DONE) {
+					continue;
+				}
+
+				FetchRequest *request = NULL;
+				CURL *handle = msg->easy_handle;
+				CURLcode result = msg->data.result;
+				curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**) &request);
+				curl_multi_remove_handle(multi, handle);
+				inFlight--;
+
+				if (request->hedge && !FinishRace(request, handle, result, inFlight)) {
+					// This copy failed, the other one is still running
+					continue;
+				}
+
+				request->result = result;
+
+				if (result == CURLE_OK) {
+					latencies.Add(std::chrono::duration<double, std::milli>(RateLimiter::Clock::now() - request->started).count());
+				}
+
+				if (request->result != CURLE_OK) {
+					fprintf(stderr, "Function ConcurrentFetcher: transfer failed attempt %d: %s\n", request->attempts, curl_easy_strerror(request->result));
+
+					if (request->attempts < retryAttempts) {
+						retries.push_back(request);
+						continue;
+					}
+				}
+
+				request->done = true;
+			}
+
+			// Wait for activity on any of the transfers (or new free slots to fill, the rate limiter, a hedge or the deadline)
+			RateLimiter::Clock::time_point wakeUp = std::min(deadline, nextHedge);
+			if (waiting) {
+				curl_multi_poll(multi, NULL, 0, PollTimeoutMs(std::min(admitAt, wakeUp)), NULL);
+			} else if (inFlight > 0 && retries.empty()) {
+				curl_multi_poll(multi, NULL, 0, PollTimeoutMs(wakeUp), NULL);
+			}
+		}
+	}
+
+	long hedges;			// Duplicates started
+	long hedgeWins;			// Duplicates that finished before the request they duplicated
+	double hedgeAfterMs;	// Latency after which the last batch hedged (0 = not hedging)
+
+private:
+	// Copying would double free the multi handle
+	ConcurrentFetcher(const ConcurrentFetcher&);
+	ConcurrentFetcher& operator=(const ConcurrentFetcher&);
+
+	// Milliseconds to wait for activity before having to act at the given point in time (at most 100)
+	static int PollTimeoutMs(RateLimiter::Clock::time_point until) {
+		long long waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(until - RateLimiter::Clock::now()).count() + 1;
+		return (int) (waitMs < 100 ? (waitMs > 0 ? waitMs : 0) : 100);
+	}
+
+	// Stop every request that is not done yet, in flight or still waiting for a slot
+	void CancelOutstanding(std::vector<FetchRequest> &requests) {
+		for (FetchRequest &request : requests) {
+			if (!request.curl || request.done) continue;
+
+			// Nothing happens for a handle that was never added
+			curl_multi_remove_handle(multi, request.curl);
+			if (request.hedge) {
+				curl_multi_remove_handle(multi, request.hedge);
+				releaseHedge(request.hedge);
+				request.hedge = NULL;
+			}
+			request.result = CURLE_OPERATION_TIMEDOUT;
+			request.cancelled = true;
+			request.done = true;
+		}
+
+		// The token taken for the next request is spent either way
+		reserved = false;
+	}
+
+	// Take a token from the rate limiter for the next request to start. False while its token is not available yet.
+	bool Admit() {
+		if (!limiter) return true;
+
+		if (!reserved) {
+			admitAt = limiter->Reserve();
+			reserved = true;
+		}
+		if (RateLimiter::Clock::now() < admitAt) {
+			return false;
+		}
+
+		reserved = false;
+		return true;
+	}
+
+	// Start a duplicate of a request that is in flight. False when no handle could be created for it.
+	bool StartHedge(FetchRequest *request) {
+		request->hedgeResponse.Clear();
+		request->hedge = createHedge(*request);
+		if (!request->hedge) {
+			return false;
+		}
+
+		hedges++;
+		curl_easy_setopt(request->hedge, CURLOPT_PRIVATE, request);
+		curl_multi_add_handle(multi, request->hedge);
+		return true;
+	}
+
+	/**
+	 *
+	 * Handle one copy of a hedged request finishing.
+	 *
+	 * The first copy to succeed (or the last one to fail) wins: when that is the duplicate, it takes the place of the request
+	 * (handle and response). The other copy is stopped and its handle released.
+	 *
+	 * @return Bool 	False when this copy failed and the other one is still running
+	*/
+	bool FinishRace(FetchRequest *request, CURL *handle, CURLcode result, int &inFlight) {
+		bool isHedge = handle == request->hedge;
+		bool otherRunning = isHedge ? !request->primaryFailed : true;
+
+		if (result != CURLE_OK && otherRunning) {
+			if (isHedge) {
+				releaseHedge(request->hedge);
+				request->hedge = NULL;
+			} else {
+				request->primaryFailed = true;
+			}
+			return false;
+		}
+
+		if (isHedge) {
+			std::swap(request->curl, request->hedge);
+			request->responseString.Swap(request->hedgeResponse);
+			if (result == CURLE_OK) hedgeWins++;
+		}
+
+		if (otherRunning) {
+			curl_multi_remove_handle(multi, request->hedge);
+			inFlight--;
+		}
+		releaseHedge(request->hedge);
+		request->hedge = NULL;
+		return true;
+	}
+
+	void Start(FetchRequest *request) {
+		request->responseString.Clear();
+		request->attempts++;
+		request->started = RateLimiter::Clock::now();
+		request->primaryFailed = false;
+		started++;
+		curl_easy_setopt(request->curl, CURLOPT_PRIVATE, request);
+		curl_multi_add_handle(multi, request->curl);
+	}
+
+	CURLM *multi;
+	int maxInFlight;
+	int retryAttempts;
+	RateLimiter *limiter;
+	bool reserved;							// A token was taken for the next request to start
+	RateLimiter::Clock::time_point admitAt;	// When that request may start
+	double hedgeRate;
+	HedgeFactory createHedge;
+	HedgeRelease releaseHedge;
+	LatencyWindow latencies;				// Latencies of the latest successful requests
+	long started;							// Requests started (duplicates not included)
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef CONDITIONAL_REQUESTS_H
+#define CONDITIONAL_REQUESTS_H
+#include <string>
+#include <map>
+#include <strings.h>
+#include <curl/curl.h>
+#include "./ReceiveBuffer.h"
+
+/**
+ *
+ * Remembers the validators (ETag / Last-Modified) the server sent for each URL and sends them back on the next request
+ * (If-None-Match / If-Modified-Since), so an unchanged resource comes back as an empty "304 Not Modified".
+ *
+ * A 304 is turned back into the body of the last 200 for the URL, so the rest of the program sees an unchanged response
+ * (and the response fingerprints skip parsing it) without the body having crossed the network again.
+ *
+ * The validators of a response are collected per handle, not per URL: two transfers of the same URL can run at the same
+ * time (a hedged duplicate), and only the one that is used may update what is remembered for the URL.
+*/
+class ConditionalRequests {
+public:
+	ConditionalRequests() : requests(0), notModified(0), bytesSaved(0) {}
+
+	~ConditionalRequests() {
+		for (auto &entry : entries) {
+			curl_slist_free_all(entry.second.headers);
+		}
+	}
+
+	/**
+	 *
+	 * Set up a handle for a request to the URL: send the validators we have for it and capture the ones in the response.
+	 * Call on every request, a pooled handle may still carry the headers of another URL.
+	*/
+	void Prepare(CURL *curl, const std::string &url) {
+		Entry &entry = entries[url];
+		Received &received = receiving[curl];
+		received.etag.clear();
+		received.lastModified.clear();
+
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, entry.headers);
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received);
+	}
+
+	/**
+	 *
+	 * Handle the response of a successful transfer to the URL.
+	 *
+	 * @param curl 				Handle the transfer was made on (the one whose response is used)
+	 * @param url 				URL the handle was prepared for
+	 * @param responseString 	Body of the response. On a 304 it is set to the body of the last 200.
+	 * @return Bool 			True when the server answered 304 Not Modified
+	*/
+	bool Finish(CURL *curl, const std::string &url, ReceiveBuffer &responseString) {
+		Entry &entry = entries[url];
+		const Received &received = receiving[curl];
+		long responseCode = 0;
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+
+		requests++;
+
+		if (responseCode == 304 && entry.headers) {
+			notModified++;
+			bytesSaved += entry.body.size();
+			responseString.Assign(entry.body.data(), entry.body.size());
+			return true;
+		}
+
+		if (responseCode != 200) {
+			return false;
+		}
+
+		if (received.etag != entry.etag || received.lastModified != entry.lastModified) {
+			entry.etag = received.etag;
+			entry.lastModified = received.lastModified;
+
+			curl_slist_free_all(entry.headers);
+			entry.headers = NULL;
+			if (!entry.etag.empty()) {
+				entry.headers = curl_slist_append(entry.headers, ("If-None-Match: " + entry.etag).c_str());
+			}
+			if (!entry.lastModified.empty()) {
+				entry.headers = curl_slist_append(entry.headers, ("If-Modified-Since: " + entry.lastModified).c_str());
+			}
+		}
+
+		// Only worth keeping when the server can answer 304 for it
+		if (entry.headers) {
+			entry.body.assign(responseString.Data(), responseString.Size());
+		} else {
+			entry.body.clear();
+		}
+
+		return false;
+	}
+
+	long requests;		// Successful transfers handled
+	long notModified;	// Of which the server answered 304 Not Modified
+	long bytesSaved;	// Body bytes that did not have to be transferred thanks to the 304s
+
+private:
+	// Copying would double free the header lists
+	ConditionalRequests(const ConditionalRequests&);
+	ConditionalRequests& operator=(const ConditionalRequests&);
+
+	struct Entry {
+		std::string etag;
+		std::string lastModified;
+		std::string body;					// Body of the last 200
+		curl_slist *headers;				// If-None-Match / If-Modified-Since to send (NULL = none)
+
+		Entry() : headers(NULL) {}
+	};
+
+	// Validators of the response a handle is receiving
+	struct Received {
+		std::string etag;
+		std::string lastModified;
+	};
+
+	// Get the value of a "Name: value\r\n" header line
+	static std::string HeaderValue(const char *line, size_t length, size_t nameLength) {
+		size_t start = nameLength;
+		while (start < length && (line[start] == ' ' || line[start] == '\t')) start++;
+		size_t end = length;
+		while (end > start && (line[end - 1] == '\r' || line[end - 1] == '\n' || line[end - 1] == ' ')) end--;
+		return std::string(line + start, end - start);
+	}
+
+	static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata) {
+		Received *received = (Received*) userdata;
+		size_t length = size * nitems;
+
+		if (length >= 5 && strncasecmp(buffer, "HTTP/", 5) == 0) {
+			// Status line of a new response (e.g. after a redirect), start over
+			received->etag.clear();
+			received->lastModified.clear();
+		} else if (length > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+			received->etag = HeaderValue(buffer, length, 5);
+		} else if (length > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0) {
+			received->lastModified = HeaderValue(buffer, length, 14);
+		}
+
+		return length;
+	}
+
+	std::map<std::string, Entry> entries;
+	std::map<CURL*, Received> receiving;	// Per handle (the pool keeps its handles, so this does not grow)
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+#include <string>
+#include <map>
+#include <vector>
+#include <string.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <curl/curl.h>
+
+/**
+ *
+ * Pool of reusable CURL easy handles keyed by "host:port".
+ *
+ * Every handle handed out by the pool is attached to one shared connection cache, so an HTTP/1.1 connection opened for
+ * one request stays alive and is picked up by the next request to the same host:port, across lights and across ticks.
+ * Handles are never cleaned up between requests, only when the pool is destroyed.
+*/
+class ConnectionPool {
+public:
+	ConnectionPool() : requests(0), newConnections(0), wireBytes(0), decodedBytes(0), resolve(NULL) {
+		share = curl_share_init();
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	}
+
+	~ConnectionPool() {
+		for (auto &entry : idle) {
+			for (CURL *curl : entry.second) {
+				curl_easy_cleanup(curl);
+			}
+		}
+		curl_share_cleanup(share);
+		curl_slist_free_all(resolve);
+	}
+
+	/**
+	 *
+	 * Get an idle handle for the host:port, or create one if all handles for it are in use.
+	 * Options set on a reused handle by a previous request are kept; the caller sets the ones that change (URL, response string).
+	 *
+	 * @param key 		host:port the handle will talk to (see KeyFromURL)
+	 * @return CURL* 	Handle to perform the request on. Must be given back with Release.
+	*/
+	CURL* Acquire(const std::string &key) {
+		std::vector<CURL*> &handles = idle[key];
+
+		if (!handles.empty()) {
+			CURL *curl = handles.back();
+			handles.pop_back();
+			return curl;
+		}
+
+		CURL *curl = curl_easy_init();
+		if (curl) {
+			curl_easy_setopt(curl, CURLOPT_SHARE, share);
+			// Keep idle connections from being dropped by the server or NAT between ticks
+			curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+			// curl_easy_perform otherwise trims the shared cache to a handful of connections, closing the ones that
+			// concurrent requests to the same host:port left open
+			curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, 64L);
+			if (resolve) {
+				curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+			}
+			if (!unixSocket.empty()) {
+				curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, unixSocket.c_str());
+			}
+		}
+		return curl;
+	}
+
+	/**
+	 *
+	 * Connect every handle the pool creates from now on to a Unix domain socket instead of host:port. The URLs keep their
+	 * host:port, it is only sent in the Host header.
+	 *
+	 * @param path 		Path of the socket ("" = connect over TCP)
+	*/
+	void SetUnixSocket(const std::string &path) {
+		unixSocket = path;
+	}
+
+	/**
+	 *
+	 * Resolve a hostname once and pin the address for every handle the pool creates from now on (CURLOPT_RESOLVE), so no
+	 * request has to resolve it again. Nothing is pinned for a hostname that already is an address.
+	 *
+	 * @param host 		Hostname to resolve
+	 * @param port 		Port the requests go to
+	 * @return Bool 	False when the hostname could not be resolved
+	*/
+	bool PinAddress(const std::string &host, int port) {
+		unsigned char buffer[sizeof(struct in6_addr)];
+		if (inet_pton(AF_INET, host.c_str(), buffer) == 1 || inet_pton(AF_INET6, host.c_str(), buffer) == 1) {
+			return true;
+		}
+
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+
+		addrinfo *result = NULL;
+		if (getaddrinfo(host.c_str(), NULL, &hints, &result) != 0 || !result) {
+			return false;
+		}
+
+		char address[INET6_ADDRSTRLEN] = "";
+		if (result->ai_family == AF_INET6) {
+			inet_ntop(AF_INET6, &((sockaddr_in6*) result->ai_addr)->sin6_addr, address, sizeof(address));
+			pinnedAddress = std::string("[") + address + "]";
+		} else {
+			inet_ntop(AF_INET, &((sockaddr_in*) result->ai_addr)->sin_addr, address, sizeof(address));
+			pinnedAddress = address;
+		}
+		freeaddrinfo(result);
+
+		resolve = curl_slist_append(resolve, (host + ":" + std::to_string(port) + ":" + pinnedAddress).c_str());
+		return true;
+	}
+
+	/**
+	 *
+	 * Give a handle back to the pool so the next request to the same host:port can reuse it (and its connection).
+	*/
+	void Release(const std::string &key, CURL *curl) {
+		if (curl) {
+			idle[key].push_back(curl);
+		}
+	}
+
+	/**
+	 *
+	 * Record a finished transfer on a pooled handle. libcurl reports how many new connections the transfer had to open,
+	 * so a transfer that reports 0 rode on a kept-alive connection. It also reports the body bytes that came over the
+	 * network, which are fewer than the bytes handed to the write function when the body was compressed.
+	 *
+	 * @param curl 			Handle the transfer was made on
+	 * @param bodyBytes 	Bytes of (decoded) body the write function received
+	*/
+	void RecordTransfer(CURL *curl, size_t bodyBytes) {
+		long connects = 0;
+		curl_off_t downloaded = 0;
+		curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+		curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+
+		requests++;
+		newConnections += connects;
+		wireBytes += downloaded;
+		decodedBytes += bodyBytes;
+	}
+
+	/**
+	 *
+	 * Takes the counts rather than reading the pool's own, so those of the pipelining client can be added to them.
+	 *
+	 * @param requests 			Requests made
+	 * @param newConnections 	Connections opened for them
+	 * @return double 	Fraction of requests that reused an existing connection (0 when no requests were made)
+	*/
+	static double ReuseRatio(long requests, long newConnections) {
+		if (requests == 0) return 0;
+		long reused = requests - newConnections;
+		if (reused < 0) reused = 0;
+		return (double) reused / requests;
+	}
+
+	/**
+	 *
+	 * Helper function to get the "host:port" pool key out of a URL such as "http://localhost:80/api/newdeveloper/lights/1"
+	*/
+	static std::string KeyFromURL(const std::string &url) {
+		size_t start = url.find("://");
+		start = (start == std::string::npos) ? 0 : start + 3;
+		size_t end = url.find('/', start);
+		return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+	}
+
+	long requests;			// Transfers recorded on pooled handles
+	long newConnections;	// Connections that had to be opened for those transfers
+	long long wireBytes;	// Body bytes received over the network (compressed when the server compressed them)
+	long long decodedBytes;	// Body bytes after decompression
+	std::string pinnedAddress;	// Address pinned by PinAddress ("" = none)
+
+private:
+	// Copying would double free the handles
+	ConnectionPool(const ConnectionPool&);
+	ConnectionPool& operator=(const ConnectionPool&);
+
+	CURLSH *share;
+	curl_slist *resolve;	// "host:port:address" entries handed to every new handle
+	std::string unixSocket;	// Socket every new handle connects to ("" = TCP)
+	std::map<std::string, std::vector<CURL*> > idle;
+};
+
+#endif
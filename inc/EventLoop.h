@@ -0,0 +1,275 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+#include <map>
+#include <chrono>
+#include <functional>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <curl/curl.h>
+
+/**
+ *
+ * Single thread event loop that drives HTTP transfers and timers without ever blocking on one of them.
+ *
+ * Sockets of the transfers are watched with epoll and handed to curl_multi_socket_action when they are ready. Two timerfds
+ * are watched alongside them: one for the timeouts libcurl asks for and one for the timers added with AddTimer (ticks, retries).
+ * Everything runs from Run() on the calling thread, callbacks included.
+*/
+class EventLoop {
+public:
+	typedef std::function<void(CURL*, CURLcode)> TransferCallback;
+	typedef std::function<void()> TimerCallback;
+	typedef std::chrono::steady_clock Clock;
+
+	EventLoop() : stopped(false) {
+		epollFd = epoll_create1(EPOLL_CLOEXEC);
+		curlTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		appTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+		Watch(curlTimerFd, EPOLLIN, EPOLL_CTL_ADD);
+		Watch(appTimerFd, EPOLLIN, EPOLL_CTL_ADD);
+
+		multi = curl_multi_init();
+		curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+		curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+		curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, CurlTimerCallback);
+		curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+		// The default cache size follows the number of handles added, which closes kept-alive connections every time
+		// a burst of transfers finishes
+		curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, 256L);
+	}
+
+	~EventLoop() {
+		for (auto &transfer : transfers) {
+			curl_multi_remove_handle(multi, transfer.first);
+		}
+		curl_multi_cleanup(multi);
+		close(appTimerFd);
+		close(curlTimerFd);
+		close(epollFd);
+	}
+
+	/**
+	 *
+	 * Limit the number of connections the transfers may use at once. Transfers beyond the limit wait inside libcurl.
+	 *
+	 * @param maxConnections 	Maximum number of open connections (0 = no limit)
+	*/
+	void SetMaxConnections(long maxConnections) {
+		curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, maxConnections);
+		if (maxConnections > 0) {
+			curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, maxConnections);
+		}
+	}
+
+	/**
+	 *
+	 * Start a transfer on a configured handle. The callback is called from Run() once the transfer is done.
+	 *
+	 * @param curl 		Configured handle (see CreateHTTPCurlHandle)
+	 * @param done 		Called with the handle and the result of the transfer. The handle is no longer part of the loop by then.
+	*/
+	void AddTransfer(CURL *curl, TransferCallback done) {
+		transfers[curl] = done;
+		curl_multi_add_handle(multi, curl);
+	}
+
+	/**
+	 *
+	 * Cancel a transfer that is not done yet. Its callback is never called.
+	*/
+	void RemoveTransfer(CURL *curl) {
+		if (transfers.erase(curl)) {
+			curl_multi_remove_handle(multi, curl);
+		}
+	}
+
+	/**
+	 *
+	 * Call a function once the given point in time is reached.
+	*/
+	void AddTimer(Clock::time_point when, TimerCallback callback) {
+		timers.insert(std::make_pair(when, callback));
+		ArmAppTimer();
+	}
+
+	/**
+	 *
+	 * Call a function after a delay (microseconds).
+	*/
+	void AddTimer(long delayMicroseconds, TimerCallback callback) {
+		AddTimer(Clock::now() + std::chrono::microseconds(delayMicroseconds), callback);
+	}
+
+	size_t TransfersInFlight() const {
+		return transfers.size();
+	}
+
+	/**
+	 *
+	 * Dispatch socket and timer events until Stop() is called.
+	*/
+	void Run() {
+		epoll_event events[64];
+
+		while (!stopped) {
+			int count = epoll_wait(epollFd, events, 64, -1);
+
+			if (count < 0) {
+				if (errno == EINTR) continue;
+				perror("epoll_wait");
+				return;
+			}
+
+			for (int i = 0; i < count && !stopped; i++) {
+				int fd = events[i].data.fd;
+
+				if (fd == curlTimerFd) {
+					DrainTimerFd(curlTimerFd);
+					SocketAction(CURL_SOCKET_TIMEOUT, 0);
+				} else if (fd == appTimerFd) {
+					DrainTimerFd(appTimerFd);
+					FireTimers();
+				} else {
+					int flags = 0;
+					if (events[i].events & EPOLLIN) flags |= CURL_CSELECT_IN;
+					if (events[i].events & EPOLLOUT) flags |= CURL_CSELECT_OUT;
+					if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= CURL_CSELECT_ERR;
+					SocketAction(fd, flags);
+				}
+			}
+		}
+	}
+
+	void Stop() {
+		stopped = true;
+	}
+
+private:
+	// Copying would double free the multi handle and file descriptors
+	EventLoop(const EventLoop&);
+	EventLoop& operator=(const EventLoop&);
+
+	void Watch(int fd, uint32_t events, int operation) {
+		epoll_event event;
+		event.events = events;
+		event.data.fd = fd;
+		epoll_ctl(epollFd, operation, fd, &event);
+	}
+
+	static void DrainTimerFd(int fd) {
+		uint64_t expirations;
+		while (read(fd, &expirations, sizeof(expirations)) > 0) {}
+	}
+
+	static void ArmTimerFd(int fd, long long nanoseconds, int flags) {
+		itimerspec spec = {};
+		spec.it_value.tv_sec = nanoseconds / 1000000000LL;
+		spec.it_value.tv_nsec = nanoseconds % 1000000000LL;
+		timerfd_settime(fd, flags, &spec, NULL);
+	}
+
+	// Arm the application timerfd for the earliest timer (steady_clock is CLOCK_MONOTONIC on Linux)
+	void ArmAppTimer() {
+		if (timers.empty()) {
+			ArmTimerFd(appTimerFd, 0, 0);
+			return;
+		}
+
+		long long when = std::chrono::duration_cast<std::chrono::nanoseconds>(timers.begin()->first.time_since_epoch()).count();
+		// 0 would disarm the timer, anything in the past fires right away
+		ArmTimerFd(appTimerFd, when > 0 ? when : 1, TFD_TIMER_ABSTIME);
+	}
+
+	void FireTimers() {
+		Clock::time_point now = Clock::now();
+
+		// Callbacks may add timers, so take the due ones out before calling them
+		while (!timers.empty() && timers.begin()->first <= now && !stopped) {
+			TimerCallback callback = timers.begin()->second;
+			timers.erase(timers.begin());
+			callback();
+		}
+
+		ArmAppTimer();
+	}
+
+	void SocketAction(curl_socket_t socket, int flags) {
+		int running = 0;
+		curl_multi_socket_action(multi, socket, flags, &running);
+		CheckFinishedTransfers();
+	}
+
+	void CheckFinishedTransfers() {
+		CURLMsg *msg;
+		int msgsLeft;
+
+		while ((msg = curl_multi_info_read(multi, &msgsLeft))) {
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+
+			CURL *curl = msg->easy_handle;
+			CURLcode result = msg->data.result;
+
+			curl_multi_remove_handle(multi, curl);
+
+			std::map<CURL*, TransferCallback>::iterator it = transfers.find(curl);
+			if (it == transfers.end()) {
+				continue;
+			}
+
+			TransferCallback done = it->second;
+			transfers.erase(it);
+			done(curl, result);
+		}
+	}
+
+	static int SocketCallback(CURL*, curl_socket_t socket, int what, void *userp, void *socketp) {
+		EventLoop *loop = (EventLoop*) userp;
+
+		if (what == CURL_POLL_REMOVE) {
+			epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, socket, NULL);
+			return 0;
+		}
+
+		uint32_t events = 0;
+		if (what & CURL_POLL_IN) events |= EPOLLIN;
+		if (what & CURL_POLL_OUT) events |= EPOLLOUT;
+
+		// socketp is set once the socket has been added to epoll
+		if (socketp) {
+			loop->Watch(socket, events, EPOLL_CTL_MOD);
+		} else {
+			loop->Watch(socket, events, EPOLL_CTL_ADD);
+			curl_multi_assign(loop->multi, socket, loop);
+		}
+		return 0;
+	}
+
+	static int CurlTimerCallback(CURLM*, long timeoutMs, void *userp) {
+		EventLoop *loop = (EventLoop*) userp;
+
+		if (timeoutMs < 0) {
+			// Disarm
+			ArmTimerFd(loop->curlTimerFd, 0, 0);
+		} else {
+			// A timeout of 0 means "call socket_action as soon as possible"
+			ArmTimerFd(loop->curlTimerFd, timeoutMs > 0 ? timeoutMs * 1000000LL : 1, 0);
+		}
+		return 0;
+	}
+
+	int epollFd;
+	int curlTimerFd;
+	int appTimerFd;
+	bool stopped;
+	CURLM *multi;
+	std::map<CURL*, TransferCallback> transfers;
+	std::multimap<Clock::time_point, TimerCallback> timers;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef EVENT_STREAM_PARSER_H
+#define EVENT_STREAM_PARSER_H
+#include <string>
+#include <functional>
+
+/**
+ *
+ * Splits a Server-Sent Events stream (text/event-stream) into events as its bytes arrive, in whatever pieces the network
+ * delivers them. Every "data:" line of an event is collected and the event is handed to the callback at the blank line
+ * that ends it. Comment lines (":" keep-alives) and unknown fields are skipped; "id:" is remembered so a reconnect can
+ * resume with Last-Event-ID.
+*/
+class EventStreamParser {
+public:
+	typedef std::function<void(const std::string &data)> EventCallback;
+
+	explicit EventStreamParser(EventCallback onEvent) : events(0), onEvent(onEvent), skipNewline(false) {}
+
+	// Feed the next bytes of the stream
+	void Feed(const char *bytes, size_t length) {
+		for (size_t i = 0; i < length; i++) {
+			char c = bytes[i];
+
+			// A line ends with \r\n, \n or \r
+			if (c == '\n' && skipNewline) {
+				skipNewline = false;
+				continue;
+			}
+			skipNewline = c == '\r';
+
+			if (c == '\r' || c == '\n') {
+				Line();
+				line.clear();
+			} else {
+				line += c;
+			}
+		}
+	}
+
+	// Start over on a new connection (the last event ID is kept)
+	void Reset() {
+		line.clear();
+		data.clear();
+		skipNewline = false;
+	}
+
+	std::string lastEventId;	// ID of the last event received ("" = none)
+	long events;				// Events handed to the callback
+
+private:
+	void Line() {
+		if (line.empty()) {
+			// End of the event
+			if (!data.empty()) {
+				events++;
+				onEvent(data);
+				data.clear();
+			}
+			return;
+		}
+
+		if (line[0] == ':') {
+			return;
+		}
+
+		size_t colon = line.find(':');
+		std::string field = line.substr(0, colon);
+		size_t start = colon == std::string::npos ? line.size() : colon + 1;
+		if (start < line.size() && line[start] == ' ') start++;
+
+		if (field == "data") {
+			if (!data.empty()) data += '\n';
+			data.append(line, start, std::string::npos);
+		} else if (field == "id") {
+			lastEventId = line.substr(start);
+		}
+	}
+
+	EventCallback onEvent;
+	std::string line;		// Line being received
+	std::string data;		// Data lines of the event being received
+	bool skipNewline;		// The last line ended with \r, a \n right after it belongs to it
+};
+
+#endif
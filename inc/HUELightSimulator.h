@@ -1,9 +1,13 @@
 
-// #ifndef HUE_LIGHT_SUMULATOR_H
-// #define HUE_LIGHT_SUMULATOR_H
+#ifndef HUE_LIGHT_SUMULATOR_H
+#define HUE_LIGHT_SUMULATOR_H
 #include <string>
 #include <map>
+#include <vector>
+#include <utility>
+#include <type_traits>
 #include "./json.hpp"
+#include "./ReceiveBuffer.h"
 
 // Describes a HUE light
 struct HueLight {
@@ -13,8 +17,130 @@ struct HueLight {
 	int bri; 		// This is actual value retrieved from the API
 	int brightness; // This is the % displayed to the user
 	bool isValid;	// To check if light is still being heard from (alive) 
+	bool stale;		// Did not answer within the sample budget, the state is from an earlier sample
 };
 
+// Describes how the simulation was configured on the command line
+struct SimulationOptions {
+	std::string hostname;	// Hostname to connect to
+	int port;				// Port to connect to
+	std::string unixSocket;	// Unix domain socket to connect to instead of hostname:port ("" = TCP)
+	int timeout;			// Time in seconds before a timeout on the GET request
+	int sleep;				// Time in microseconds between each GET request
+	int retryAttempts;		// Attempts to retry making a connection with the server before giving up
+	bool snapshot;			// Build the lights from the "Query all" response instead of requesting each light
+	int statsInterval;		// Print the performance counters every statsInterval samples (0 = never)
+	int maxInFlight;		// Maximum number of per-light requests on the wire at once (1 = one after another)
+	bool eventLoop;			// Drive everything from the non-blocking event loop instead of blocking requests
+	std::string fleet;		// Path of the fleet file listing the bridges to monitor ("" = only hostname:port)
+	bool compressed;		// Ask the server for gzip/deflate compressed responses
+	bool catchUp;			// Take the samples missed by an overrun right away instead of skipping them
+	int minInterval;		// Shortest time in microseconds between samples in adaptive polling mode
+	int maxInterval;		// Longest time in microseconds between samples in adaptive polling mode (0 = fixed interval)
+	double rateLimit;		// Maximum requests per second to a bridge (0 = no limit)
+	int burst;				// Requests that may go out back to back before the rate limit applies
+	int refreshSlice;		// Lights whose details are requested per sample, taking turns (0 = all of them)
+	int tickBudget;			// Percentage of the sample interval the light requests of a sample may take (0 = no budget)
+	int hedgeRate;			// Percentage of the light requests that may be duplicated when they are slow (0 = no hedging)
+	bool warmUp;			// Resolve the hostname and open the connections before the first sample
+	bool pipeline;			// Send the requests through the built-in pipelining HTTP/1.1 client instead of libcurl
+	bool eventStream;		// Apply the changes pushed on the bridge's event stream, the samples only resync
+	std::string jsonParser;	// How the responses are parsed: "dom" (build a json document), "sax" (straight into the lights), "schema" (hand written for the light shape, "dom" for anything else), "simd" (structural index, "schema" for anything else) or "stream" ("schema" while the "Query all" response is received)
+	std::string simdKernel;	// First pass of the "simd" parser: "avx2", "sse4.2" or "scalar"
+	bool verifyParser;		// Check the parser picked by jsonParser against the DOM parser on every response and mutated copies of it
+};
+
+// Describes the performance counters collected while the simulation runs
+struct SimulationStats {
+	long ticks;				// Samples taken
+	double totalTickMs;		// Sum of the time every sample took (requests + processing)
+	double maxTickMs;		// Slowest sample
+	long changes;			// Changes detected (changed attributes, new lights and lights gone)
+	double totalDetectionLatencyMs;	// Sum of the estimated time between every change happening and it being detected
+	long ticksOverBudget;	// Samples whose light requests were cut off by the sample budget
+	std::map<int, long> budgetLights;	// Per light ID, how often its request was still outstanding at the budget
+	double resolveMs;		// Time the hostname took to resolve before the first sample (warm-up)
+	double warmUpMs;		// Time opening the connections took before the first sample (warm-up)
+	double firstSnapshotMs;	// Time from starting to monitor the bridge until the first snapshot was printed
+	double totalCpuMs;		// CPU time the samples took on the thread that ran them
+	long bufferAllocations;	// Times the receive buffers had to grow
+	long lastSampleAllocations;	// Of which during the last sample
+	long streamEvents;		// Events received on the event stream
+	long streamChanges;		// Of the changes, the ones applied from the event stream (the rest were caught by a sample)
+	long streamConnects;	// Times the event stream was (re)connected
+	long lightsParsed;		// Individual light responses parsed (the unchanged ones are not parsed again)
+	double lightParseNs;	// Time parsing them took
+	long lightParseAllocations;	// Heap allocations parsing them made
+	long collectionMembers;	// Members of the "Query all" responses parsed
+	double collectionParseNs;	// Time parsing them took
+	long collectionParseAllocations;	// Heap allocations parsing them made
+	long parserFallbacks;	// Responses the schema, simd or stream parser handed to a slower parser
+	long long collectionParseBytes;	// Bytes of the "Query all" responses parsed
+	long lightStateUpdates;	// Samples whose lights were compared with the known ones (not the first, nor unchanged ones)
+	long lightStateUpdateAllocations;	// Heap allocations comparing and updating the light states made
+
+	SimulationStats() : ticks(0), totalTickMs(0), maxTickMs(0), changes(0), totalDetectionLatencyMs(0), ticksOverBudget(0), resolveMs(0), warmUpMs(0), firstSnapshotMs(0), totalCpuMs(0), bufferAllocations(0), lastSampleAllocations(0), streamEvents(0), streamChanges(0), streamConnects(0), lightsParsed(0), lightParseNs(0), lightParseAllocations(0), collectionMembers(0), collectionParseNs(0), collectionParseAllocations(0), parserFallbacks(0), collectionParseBytes(0), lightStateUpdates(0), lightStateUpdateAllocations(0) {}
+};
+
+/**
+ *
+ * Set the brightness of a light from the "bri" value the API returns
+ *
+ * @param light 	HueLight to set the brightness of
+ * @param bri 		Brightness as returned by the API (1 to 254)
+*/
+inline void SetLightBrightness(HueLight &light, int bri) {
+	light.bri = bri;
+
+	// https://developers.meethue.com/develop/hue-api/lights-api/
+	// Note: Brightness of the light. This is a scale from the minimum brightness the light is capable of, 1, to the maximum capable brightness, 254.
+	if (bri > 254) bri = 254;
+	if (bri < 1) bri = 1;
+	light.brightness = (int) (100 * bri / 254);
+}
+
+namespace nlohmann {
+/**
+ *
+ * Lets nlohmann::json and nlohmann::ordered_json convert HueLight objects themselves (json j = light, j.get<HueLight>()),
+ * as the printed light: {"name", "id", "on", "brightness"}. A light that is an rvalue gives its name to the json instead
+ * of copying it, and a json that is an rvalue gives its name to the light.
+*/
+template <>
+struct adl_serializer<HueLight> {
+	template <typename BasicJsonType>
+	static void to_json(BasicJsonType &j, const HueLight &l) {
+		j = BasicJsonType{ {"name", l.name}, {"id", l.id}, {"on", l.on}, {"brightness", l.brightness}};
+	}
+
+	template <typename BasicJsonType>
+	static void to_json(BasicJsonType &j, HueLight &&l) {
+		j = BasicJsonType{ {"name", std::move(l.name)}, {"id", l.id}, {"on", l.on}, {"brightness", l.brightness}};
+	}
+
+	template <typename BasicJsonType>
+	static void from_json(const BasicJsonType &j, HueLight &l) {
+		l.name = j.at("name").template get<std::string>();
+		FromJsonFields(j, l);
+	}
+
+	template <typename BasicJsonType, typename std::enable_if<!std::is_lvalue_reference<BasicJsonType>::value, int>::type = 0>
+	static void from_json(BasicJsonType &&j, HueLight &l) {
+		l.name = std::move(j.at("name").template get_ref<typename BasicJsonType::string_t&>());
+		FromJsonFields(j, l);
+	}
+
+private:
+	// Everything but the name
+	template <typename BasicJsonType>
+	static void FromJsonFields(const BasicJsonType &j, HueLight &l) {
+		l.id = j.at("id");
+		l.on = j.at("on");
+		l.brightness = j.at("brightness");
+	}
+};
+}
+
 /**
  *
  * Function converts from a single HueLight object to a json
@@ -22,8 +148,8 @@ struct HueLight {
  * @param HueLight 			HueLight object to convert
  * @return ordered_json 	Ordered Json converted from the HueLight
 */
-nlohmann::ordered_json to_json(HueLight l) {
-    return nlohmann::ordered_json{ {"name", l.name}, {"id", l.id}, {"on", l.on}, {"brightness", l.brightness}};
+nlohmann::ordered_json to_json(const HueLight &l) {
+    return nlohmann::ordered_json(l);
 }
 
 /**
@@ -33,13 +159,8 @@ nlohmann::ordered_json to_json(HueLight l) {
  * @param j 			Json object to convert
  * @return HueLight 	HueLight Object converted from the JSON
 */
-HueLight from_json(nlohmann::json j) {
-	HueLight l;
-    l.name = j.at("name");
-    l.id = j.at("id");
-    l.on = j.at("on");
-    l.brightness = j.at("brightness");
-    return l;
+HueLight from_json(const nlohmann::json &j) {
+    return j.get<HueLight>();
 }
 
 /**
@@ -49,11 +170,35 @@ HueLight from_json(nlohmann::json j) {
  * @param lights 		Vector of HueLight objects to convert
  * @return ordered_json JSON object created from a vector of lights
 */
-nlohmann::ordered_json to_json_vector(std::vector<HueLight> lights) {
-	nlohmann::ordered_json j = {};
-	for (HueLight it : lights) { 
-        j.push_back(to_json(it));
-    } 
+nlohmann::ordered_json to_json_vector(const std::vector<HueLight> &lights) {
+	// No lights print as null
+	nlohmann::ordered_json j;
+	if (lights.empty()) return j;
+
+	j = nlohmann::ordered_json::array();
+	j.get_ref<nlohmann::ordered_json::array_t&>().reserve(lights.size());
+	for (const HueLight &it : lights) {
+        j.emplace_back(it);
+    }
+    return j;
+}
+
+/**
+ *
+ * Same as above for lights that are no longer needed: their names are moved into the json instead of copied.
+ *
+ * @param lights 		Vector of HueLight objects to convert (left with empty names)
+ * @return ordered_json JSON object created from a vector of lights
+*/
+nlohmann::ordered_json to_json_vector(std::vector<HueLight> &&lights) {
+	nlohmann::ordered_json j;
+	if (lights.empty()) return j;
+
+	j = nlohmann::ordered_json::array();
+	j.get_ref<nlohmann::ordered_json::array_t&>().reserve(lights.size());
+	for (HueLight &it : lights) {
+        j.emplace_back(std::move(it));
+    }
     return j;
 }
 
@@ -64,12 +209,31 @@ nlohmann::ordered_json to_json_vector(std::vector<HueLight> lights) {
  * @param j 				JSON to be converted (a light of json objects)
  * @return vector<HueLight> Vector of converted HueLight objects
 */
-std::vector<HueLight> to_HueLight_vector(nlohmann::json j) {
+std::vector<HueLight> to_HueLight_vector(const nlohmann::json &j) {
 	std::vector<HueLight> lights;
+	lights.reserve(j.size());
 
-	for (auto it : j)
-	{
-		lights.push_back(from_json(it));
+	for (const nlohmann::json &it : j) {
+		lights.push_back(it.get<HueLight>());
+	}
+
+    return lights;
+}
+
+/**
+ *
+ * Same as above for a json that is no longer needed: the names are moved into the lights instead of copied.
+ *
+ * @param j 				JSON to be converted (left with empty names)
+ * @return vector<HueLight> Vector of converted HueLight objects
+*/
+std::vector<HueLight> to_HueLight_vector(nlohmann::json &&j) {
+	std::vector<HueLight> lights;
+	lights.reserve(j.size());
+
+	for (nlohmann::json &it : j) {
+		lights.emplace_back();
+		nlohmann::adl_serializer<HueLight>::from_json(std::move(it), lights.back());
 	}
 
     return lights;
@@ -94,21 +258,10 @@ void setIsValid(std::vector<HueLight> &lights, bool b) {
  *
  * This was taken from the curl API. It is how you read data in from a request (prototype).
 */
-size_t writeFunction(void *ptr, size_t size, size_t nmemb, std::string* data) {
-    data->append((char*) ptr, size * nmemb);
+size_t writeFunction(void *ptr, size_t size, size_t nmemb, ReceiveBuffer* data) {
+    data->Append((char*) ptr, size * nmemb);
     return size * nmemb;
 }
 
 
-/**
- *
- * Helper function to create a char* url from a string.
-*/
-char* createURLFromString(std::string urlString) {
-	char* url = new char[urlString.length() + 1];
-	strcpy(url, urlString.c_str());
-	return url;
-}
-
-
-// #endif
\ No newline at end of file
+#endif
\ No newline at end of file
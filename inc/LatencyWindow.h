@@ -0,0 +1,54 @@
+#ifndef LATENCY_WINDOW_H
+#define LATENCY_WINDOW_H
+#include <vector>
+#include <algorithm>
+
+/**
+ *
+ * Keeps the most recent latencies (milliseconds) and answers percentiles over them, so the percentiles follow the
+ * server as it speeds up or slows down.
+*/
+class LatencyWindow {
+public:
+	/**
+	 *
+	 * @param capacity 	Number of most recent latencies to keep
+	*/
+	explicit LatencyWindow(size_t capacity) : capacity(capacity < 1 ? 1 : capacity), next(0) {}
+
+	void Add(double ms) {
+		if (values.size() < capacity) {
+			values.push_back(ms);
+		} else {
+			values[next] = ms;
+			next = (next + 1) % capacity;
+		}
+	}
+
+	size_t Count() const {
+		return values.size();
+	}
+
+	/**
+	 *
+	 * @param percentile 	Percentile to compute (0 - 100)
+	 * @return double 		Latency that percentile percent of the kept latencies are at or below (0 when none are kept)
+	*/
+	double Percentile(double percentile) const {
+		if (values.empty()) return 0;
+
+		std::vector<double> sorted(values);
+		size_t rank = (size_t) (percentile / 100.0 * (sorted.size() - 1) + 0.5);
+		if (rank >= sorted.size()) rank = sorted.size() - 1;
+
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+		return sorted[rank];
+	}
+
+private:
+	size_t capacity;
+	size_t next;				// Slot the next latency overwrites once the window is full
+	std::vector<double> values;
+};
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef LIGHT_SAX_PARSER_H
+#define LIGHT_SAX_PARSER_H
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include "./json.hpp"
+#include "./HUELightSimulator.h"
+
+/**
+ *
+ * Reads lights straight out of the JSON text through nlohmann's SAX interface, without building a DOM: name, state.on
+ * and state.bri are picked out as they go by and everything else is skipped. A light is accepted and rejected exactly
+ * like ParseLightObject does on a DOM (a missing field, a field of the wrong type or a "state" that is not an object
+ * fails it; for a repeated key the last one counts).
+ *
+ * It parses either one light object (the individual light request) or the "Query all" collection, whose top level
+ * members are the lights keyed by ID. For the collection it lists the members and, when asked, keeps the lights; a key
+ * that is repeated is resolved afterwards like the DOM does (the last one counts, see SaxParseCollection).
+*/
+class LightSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+public:
+	/**
+	 *
+	 * @param collection 	Parse the "Query all" collection instead of one light object
+	 * @param keepLights 	Keep the lights of the collection (otherwise they are only counted)
+	 * @param id 			ID of the light (one light object only)
+	*/
+	LightSaxHandler(bool collection, bool keepLights, int id) :
+		elements(0),
+		valid(false),
+		collection(collection),
+		keepLights(keepLights),
+		lightDepth(collection ? 2 : 1),
+		depth(0),
+		rootIsArray(false),
+		inLight(false),
+		inState(false),
+		lightId(id),
+		idValid(true),
+		on(false),
+		bri(0),
+		nameField(Missing),
+		stateField(Missing),
+		onField(Missing),
+		briField(Missing) {
+	}
+
+	bool null() override {
+		// A null document has no elements, like an empty DOM
+		if (depth == 0) return true;
+		Scalar(false, false, false);
+		return true;
+	}
+
+	bool boolean(bool val) override {
+		Field field = Current();
+		Scalar(false, true, true);
+		if (field == On) on = val;
+		if (field == Bri) bri = val ? 1 : 0;
+		return true;
+	}
+
+	bool number_integer(number_integer_t val) override {
+		Number((int) val);
+		return true;
+	}
+
+	bool number_unsigned(number_unsigned_t val) override {
+		Number((int) val);
+		return true;
+	}
+
+	bool number_float(number_float_t val, const string_t&) override {
+		Number((int) val);
+		return true;
+	}
+
+	bool string(string_t &val) override {
+		if (Current() == Name) name = val;
+		Scalar(true, false, false);
+		return true;
+	}
+
+	bool binary(binary_t&) override {
+		Scalar(false, false, false);
+		return true;
+	}
+
+	bool start_object(std::size_t) override {
+		Field field = Current();
+
+		if (depth == lightDepth - 1 && collection) {
+			CountRootValue();
+		} else if (field == State) {
+			stateField = Valid;
+			onField = Missing;
+			briField = Missing;
+			inState = true;
+		} else if (field != None) {
+			Set(field, Wrong);
+		}
+
+		depth++;
+
+		// Only counting the collection: the lights do not need to be looked at
+		if (depth == lightDepth && !rootIsArray && (keepLights || !collection)) {
+			BeginLight();
+		}
+		return true;
+	}
+
+	bool key(string_t &val) override {
+		if (collection && depth == 1) {
+			memberKey = val;
+			members.push_back(Member(val));
+		}
+		currentKey = val;
+		return true;
+	}
+
+	bool end_object() override {
+		if (inState && depth == lightDepth + 1) {
+			inState = false;
+		} else if (inLight && depth == lightDepth) {
+			EndLight();
+		}
+		depth--;
+		return true;
+	}
+
+	bool start_array(std::size_t) override {
+		if (depth == 0) {
+			rootIsArray = true;
+		} else {
+			Scalar(false, false, false);
+		}
+		depth++;
+		return true;
+	}
+
+	bool end_array() override {
+		depth--;
+		return true;
+	}
+
+	bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+		return false;
+	}
+
+	// A member of the collection
+	struct Member {
+		explicit Member(const std::string &key) : key(key), light(-1) {}
+
+		std::string key;
+		int light;			// Index of its light in lights (-1 = not a valid light, or not kept)
+	};
+
+	int elements;					// Elements of a top level array or 1 for another value that is not an object
+	std::vector<Member> members;	// Members of the collection in document order, repeated keys included
+	std::vector<HueLight> lights;	// Lights of the collection in document order (keepLights)
+	HueLight light;					// The light (one light object, when valid)
+	bool valid;						// The light object held a valid light
+
+private:
+	enum Field { None, Name, State, On, Bri };
+	enum FieldState { Missing, Valid, Wrong };
+
+	// Which field of the light the next value is for
+	Field Current() const {
+		if (!inLight) return None;
+		if (depth == lightDepth) {
+			if (currentKey == "name") return Name;
+			if (currentKey == "state") return State;
+		} else if (depth == lightDepth + 1 && inState) {
+			if (currentKey == "on") return On;
+			if (currentKey == "bri") return Bri;
+		}
+		return None;
+	}
+
+	void Set(Field field, FieldState state) {
+		switch (field) {
+			case Name: nameField = state; break;
+			case State: stateField = state; inState = false; break;
+			case On: onField = state; break;
+			case Bri: briField = state; break;
+			default: break;
+		}
+	}
+
+	// A value that is not an object: which fields it is valid for
+	void Scalar(bool isString, bool isBoolean, bool isNumberLike) {
+		if (depth == lightDepth - 1 && collection) {
+			// A member of the collection that is not an object
+			CountRootValue();
+			return;
+		}
+
+		if (depth == 0) {
+			// The root is not an object: not a light, and one element like the size of a DOM
+			if (collection) elements = 1;
+			return;
+		}
+
+		Field field = Current();
+		switch (field) {
+			case Name: nameField = isString ? Valid : Wrong; break;
+			case State: Set(State, Wrong); break;
+			case On: onField = isBoolean ? Valid : Wrong; break;
+			case Bri: briField = isNumberLike ? Valid : Wrong; break;
+			default: break;
+		}
+	}
+
+	void Number(int value) {
+		if (Current() == Bri) bri = value;
+		Scalar(false, false, true);
+	}
+
+	// Values of a top level array count as elements, like they do for the size of a DOM
+	void CountRootValue() {
+		if (rootIsArray) elements++;
+	}
+
+	void BeginLight() {
+		inLight = true;
+		inState = false;
+		nameField = Missing;
+		stateField = Missing;
+		onField = Missing;
+		briField = Missing;
+
+		if (collection) {
+			try {
+				lightId = std::stoi(memberKey);
+				idValid = true;
+			} catch (...) {
+				idValid = false;
+			}
+		}
+	}
+
+	void EndLight() {
+		inLight = false;
+		bool complete = idValid && nameField == Valid && stateField == Valid && onField == Valid && briField == Valid;
+
+		if (!complete) {
+			return;
+		}
+
+		HueLight parsed;
+		parsed.id = lightId;
+		parsed.name = name;
+		parsed.on = on;
+		SetLightBrightness(parsed, bri);
+		parsed.isValid = true;
+		parsed.stale = false;
+
+		if (!collection) {
+			light = parsed;
+			valid = true;
+		} else if (keepLights) {
+			members.back().light = (int) lights.size();
+			lights.push_back(parsed);
+		}
+	}
+
+	bool collection;
+	bool keepLights;
+	int lightDepth;				// Depth of the containers the light objects are in (1 = root)
+	int depth;					// Containers open
+	bool rootIsArray;
+	bool inLight;				// Inside a light object
+	bool inState;				// Inside the "state" object of the light
+	std::string currentKey;		// Last key seen (its capacity is reused)
+	std::string memberKey;		// Key of the collection member being parsed
+	int lightId;
+	bool idValid;
+	std::string name;
+	bool on;
+	int bri;
+	FieldState nameField;
+	FieldState stateField;
+	FieldState onField;
+	FieldState briField;
+};
+
+/**
+ *
+ * Parse one light object without building a DOM.
+ *
+ * @return Bool 	False when the text is not valid JSON or does not describe a valid light
+*/
+inline bool SaxParseLight(const char *begin, const char *end, int id, HueLight &light) {
+	LightSaxHandler handler(false, false, id);
+	if (!nlohmann::json::sax_parse(begin, end, &handler) || !handler.valid) {
+		return false;
+	}
+	light = handler.light;
+	return true;
+}
+
+/**
+ *
+ * Parse the "Query all" collection without building a DOM.
+ *
+ * @param elements 		Set to the number of members of the collection
+ * @param lights 		When not NULL, set to the valid lights of the collection sorted by ID
+ * @param invalidKeys 	When not NULL, set to the keys of the members that are not valid lights instead of printing them
+ * @return Bool 		False when the text is not valid JSON (nothing is reported then, like json::parse throwing)
+*/
+inline bool SaxParseCollection(const char *begin, const char *end, int &elements, std::vector<HueLight> *lights, std::vector<std::string> *invalidKeys = NULL) {
+	LightSaxHandler handler(true, lights != NULL, 0);
+	if (!nlohmann::json::sax_parse(begin, end, &handler)) {
+		return false;
+	}
+
+	// The DOM only reads lights out of an object: it fails on the elements of any other value (an empty one has none)
+	if (lights && handler.elements > 0) {
+		return false;
+	}
+
+	// In key order, like iterating the DOM does. Of a repeated key only the last member counts, like in the DOM
+	std::vector<LightSaxHandler::Member> &members = handler.members;
+	std::stable_sort(members.begin(), members.end(), [](const LightSaxHandler::Member &a, const LightSaxHandler::Member &b) { return a.key < b.key; });
+
+	std::vector<std::string> invalid;
+	std::vector<HueLight> valid;
+	elements = handler.elements;
+
+	for (size_t i = 0; i < members.size(); i++) {
+		if (i + 1 < members.size() && members[i + 1].key == members[i].key) {
+			continue;
+		}
+
+		elements++;
+		if (!lights) continue;
+
+		if (members[i].light < 0) {
+			invalid.push_back(members[i].key);
+		} else {
+			valid.push_back(std::move(handler.lights[members[i].light]));
+		}
+	}
+
+	if (invalidKeys) {
+		invalidKeys->swap(invalid);
+	} else {
+		for (const std::string &key : invalid) {
+			printf("ERROR: Program is unable to parse JSON object for ID = %s.\n", key.c_str());
+		}
+	}
+
+	if (lights) {
+		lights->swap(valid);
+		std::sort(lights->begin(), lights->end(), [](const HueLight &a, const HueLight &b) { return a.id < b.id; });
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,410 @@
+#ifndef LIGHT_SCHEMA_PARSER_H
+#define LIGHT_SCHEMA_PARSER_H
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "./HUELightSimulator.h"
+
+/**
+ *
+ * Single pass parser for the one shape the bridge sends: a light object with "name" and a "state" object holding "on"
+ * and "bri" (or the "Query all" collection of them keyed by ID). It reads the response text in place and fills the
+ * HueLight without allocating anything itself (a name longer than the short string buffer still has to be copied into
+ * the light).
+ *
+ * It only handles the plain case and gives up (returns false) on anything else: an escape in a key or the name, a byte
+ * outside ASCII, a "bri" that is not an integer, a number with an exponent, a field that is missing, repeated or of the wrong type, an ID that is
+ * not a plain number below MaxId, nesting deeper than MaxDepth, or any text that is not valid JSON. The caller then
+ * parses the response with nlohmann::json as before, so the lights and the errors printed are always the same as the
+ * DOM parser's. Skipped values are checked as strictly as nlohmann::json checks them.
+*/
+class LightSchemaParser {
+public:
+	static const int MaxDepth = 64;		// Deepest nesting of skipped values handled
+	static const int MaxId = 65536;		// IDs handled in a collection (a bridge holds at most 63 lights, emulators many more)
+
+	LightSchemaParser(const char *begin, const char *end) : p(begin), end(end) {}
+
+	/**
+	 *
+	 * @param id 		ID of the light (the key it is stored under on the server)
+	 * @param light 	Set to the parsed light
+	 * @return Bool 	False when the response has to be parsed by nlohmann::json instead
+	*/
+	bool ParseLight(int id, HueLight &light) {
+		Whitespace();
+		return LightObject(id, light) && Finished();
+	}
+
+	/**
+	 *
+	 * @param elements 	Set to the number of members of the collection
+	 * @param lights 	When not NULL, the lights of the collection are added to it (sorted by ID)
+	 * @return Bool 	False when the response has to be parsed by nlohmann::json instead
+	*/
+	bool ParseCollection(int &elements, std::vector<HueLight> *lights) {
+		size_t first = lights ? lights->size() : 0;
+
+		if (!Collection(elements, lights, first)) {
+			// Leave nothing half done for the DOM parser
+			if (lights) lights->erase(lights->begin() + first, lights->end());
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 *
+	 * Start a collection that arrives in pieces (see StreamingLightParser): the opening brace, and the closing one if it
+	 * is empty.
+	 *
+	 * @param empty 	Set when the collection has no members
+	 * @return Bool 	False when it could not be parsed; Truncated() tells whether more text could still make it parse
+	*/
+	bool OpenCollection(bool &empty) {
+		Whitespace();
+		if (!Consume('{')) return false;
+		Whitespace();
+		empty = Consume('}');
+		return true;
+	}
+
+	/**
+	 *
+	 * Parse one member of a collection that arrives in pieces ("ID": light) and the comma or closing brace after it.
+	 *
+	 * @param id 		Set to the ID of the member
+	 * @param light 	When not NULL, set to its light (otherwise the value is only checked)
+	 * @param last 		Set when it was the last member
+	 * @return Bool 	False when it could not be parsed; Truncated() tells whether more text could still make it parse
+	*/
+	bool CollectionMember(int &id, HueLight *light, bool &last) {
+		const char *key;
+		size_t keyLength;
+
+		if (!Key(key, keyLength) || !Id(key, keyLength, id)) return false;
+
+		if (light) {
+			if (!LightObject(id, *light)) return false;
+		} else if (!SkipValue(1)) {
+			return false;
+		}
+
+		if (!NextMember()) return false;
+		last = Consume('}');
+		return true;
+	}
+
+	// Nothing but whitespace may follow the value
+	bool Finished() {
+		Whitespace();
+		return p == end;
+	}
+
+	// The text ran out: more of it could still make the last call parse
+	bool Truncated() const {
+		return p == end;
+	}
+
+	const char* Position() const {
+		return p;
+	}
+
+private:
+	bool Collection(int &elements, std::vector<HueLight> *lights, size_t first) {
+		// The DOM counts repeated keys once: give up on them
+		uint64_t seen[MaxId / 64];
+		memset(seen, 0, sizeof(seen));
+		int count = 0;
+
+		Whitespace();
+		if (!Consume('{')) return false;
+		Whitespace();
+
+		if (!Consume('}')) {
+			for (;;) {
+				const char *key;
+				size_t keyLength;
+				int id;
+
+				if (!Key(key, keyLength) || !Id(key, keyLength, id)) return false;
+				if (seen[id / 64] & (1ULL << (id % 64))) return false;
+				seen[id / 64] |= 1ULL << (id % 64);
+				count++;
+
+				if (lights) {
+					HueLight light;
+					if (!LightObject(id, light)) return false;
+					lights->push_back(std::move(light));
+				} else if (!SkipValue(1)) {
+					return false;
+				}
+
+				if (!NextMember()) return false;
+				if (Consume('}')) break;
+			}
+		}
+
+		if (!Finished()) return false;
+
+		elements = count;
+		if (lights) {
+			std::sort(lights->begin() + first, lights->end(), [](const HueLight &a, const HueLight &b) { return a.id < b.id; });
+		}
+		return true;
+	}
+
+	bool LightObject(int id, HueLight &light) {
+		const char *name = NULL;
+		size_t nameLength = 0;
+		bool haveState = false;
+		bool on = false, haveOn = false;
+		int bri = 0;
+		bool haveBri = false;
+
+		if (!Consume('{')) return false;
+		Whitespace();
+		if (Consume('}')) return false;
+
+		for (;;) {
+			const char *key;
+			size_t keyLength;
+
+			if (!Key(key, keyLength)) return false;
+
+			if (Is(key, keyLength, "name")) {
+				if (name) return false;
+				if (!PlainString(name, nameLength)) return false;
+			} else if (Is(key, keyLength, "state")) {
+				if (haveState) return false;
+				haveState = true;
+				if (!State(on, haveOn, bri, haveBri)) return false;
+			} else if (!SkipValue(1)) {
+				return false;
+			}
+
+			if (!NextMember()) return false;
+			if (Consume('}')) break;
+		}
+
+		if (!name || !haveOn || !haveBri) return false;
+
+		light.id = id;
+		light.name.assign(name, nameLength);
+		light.on = on;
+		SetLightBrightness(light, bri);
+		light.isValid = true;
+		light.stale = false;
+		return true;
+	}
+
+	bool State(bool &on, bool &haveOn, int &bri, bool &haveBri) {
+		if (!Consume('{')) return false;
+		Whitespace();
+		if (Consume('}')) return false;
+
+		for (;;) {
+			const char *key;
+			size_t keyLength;
+
+			if (!Key(key, keyLength)) return false;
+
+			if (Is(key, keyLength, "on")) {
+				if (haveOn) return false;
+				haveOn = true;
+				if (Literal("true")) on = true;
+				else if (Literal("false")) on = false;
+				else return false;
+			} else if (Is(key, keyLength, "bri")) {
+				if (haveBri) return false;
+				haveBri = true;
+				if (!Integer(bri)) return false;
+			} else if (!SkipValue(2)) {
+				return false;
+			}
+
+			if (!NextMember()) return false;
+			if (Consume('}')) return true;
+		}
+	}
+
+	// A key and the colon after it, the value is next
+	bool Key(const char *&key, size_t &length) {
+		if (!PlainString(key, length)) return false;
+		Whitespace();
+		if (!Consume(':')) return false;
+		Whitespace();
+		return true;
+	}
+
+	// After a member: a comma and the next key, or the closing brace (left for the caller)
+	bool NextMember() {
+		Whitespace();
+		if (Consume(',')) {
+			Whitespace();
+			return p < end && *p == '"';
+		}
+		return p < end && *p == '}';
+	}
+
+	// A string without escapes, read in place
+	bool PlainString(const char *&start, size_t &length) {
+		if (!Consume('"')) return false;
+		start = p;
+		while (p < end && *p != '"') {
+			unsigned char c = *p;
+			if (c < 0x20 || c >= 0x80 || c == '\\') return false;
+			p++;
+		}
+		if (p == end) return false;
+		length = p - start;
+		p++;
+		return true;
+	}
+
+	// A whole number small enough for an int (bri)
+	bool Integer(int &value) {
+		bool negative = Consume('-');
+		const char *digits = p;
+		long number = 0;
+
+		while (p < end && *p >= '0' && *p <= '9') {
+			number = number * 10 + (*p - '0');
+			p++;
+			if (p - digits > 9) return false;
+		}
+
+		if (p == digits || (*digits == '0' && p - digits > 1)) return false;
+		// A fraction or exponent makes it a float
+		if (p < end && (*p == '.' || *p == 'e' || *p == 'E')) return false;
+
+		value = (int) (negative ? -number : number);
+		return true;
+	}
+
+	// The key of a collection member as a light ID
+	bool Id(const char *key, size_t length, int &id) {
+		if (length == 0 || length > 5 || (key[0] == '0' && length > 1)) return false;
+
+		id = 0;
+		for (size_t i = 0; i < length; i++) {
+			if (key[i] < '0' || key[i] > '9') return false;
+			id = id * 10 + (key[i] - '0');
+		}
+		return id < MaxId;
+	}
+
+	// Any JSON value, checked but not kept
+	bool SkipValue(int depth) {
+		if (depth > MaxDepth || p == end) return false;
+
+		switch (*p) {
+			case '{':
+			case '[': {
+				char close = *p == '{' ? '}' : ']';
+				p++;
+				Whitespace();
+				if (Consume(close)) return true;
+
+				for (;;) {
+					if (close == '}') {
+						if (!SkipString()) return false;
+						Whitespace();
+						if (!Consume(':')) return false;
+						Whitespace();
+					}
+					if (!SkipValue(depth + 1)) return false;
+					Whitespace();
+					if (Consume(close)) return true;
+					if (!Consume(',')) return false;
+					Whitespace();
+				}
+			}
+			case '"':
+				return SkipString();
+			case 't':
+				return Literal("true");
+			case 'f':
+				return Literal("false");
+			case 'n':
+				return Literal("null");
+			default:
+				return SkipNumber();
+		}
+	}
+
+	// A string, with its escapes checked (\u is left to nlohmann::json, it checks the surrogate pairs)
+	bool SkipString() {
+		if (!Consume('"')) return false;
+		while (p < end && *p != '"') {
+			unsigned char c = *p++;
+			if (c < 0x20 || c >= 0x80) return false;
+			if (c == '\\') {
+				if (p == end || !strchr("\"\\/bfnrt", *p) || *p == '\0') return false;
+				p++;
+			}
+		}
+		if (p == end) return false;
+		p++;
+		return true;
+	}
+
+	// -?(0|[1-9][0-9]*)(.[0-9]+)? (an exponent or a number too long for a double is left to nlohmann::json, it rejects
+	// the ones that overflow)
+	bool SkipNumber() {
+		const char *start = p;
+		Consume('-');
+		if (Consume('0')) {
+		} else if (p < end && *p >= '1' && *p <= '9') {
+			Digits();
+		} else {
+			return false;
+		}
+
+		if (Consume('.') && !Digits()) return false;
+		if (p < end && (*p == 'e' || *p == 'E')) return false;
+		return p - start < 300;
+	}
+
+	bool Digits() {
+		const char *start = p;
+		while (p < end && *p >= '0' && *p <= '9') p++;
+		return p > start;
+	}
+
+	bool Literal(const char *literal) {
+		size_t length = strlen(literal);
+		size_t available = end - p;
+
+		if (available < length) {
+			// Cut short: a collection arriving in pieces waits for the rest when the start matches (see Truncated)
+			if (memcmp(p, literal, available) == 0) p = end;
+			return false;
+		}
+		if (memcmp(p, literal, length) != 0) return false;
+		p += length;
+		return true;
+	}
+
+	bool Is(const char *key, size_t length, const char *name) {
+		return strlen(name) == length && memcmp(key, name, length) == 0;
+	}
+
+	bool Consume(char c) {
+		if (p < end && *p == c) {
+			p++;
+			return true;
+		}
+		return false;
+	}
+
+	void Whitespace() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+	}
+
+	const char *p;
+	const char *end;
+};
+
+#endif
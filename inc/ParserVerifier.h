@@ -0,0 +1,96 @@
+#ifndef PARSER_VERIFIER_H
+#define PARSER_VERIFIER_H
+#include <stdio.h>
+#include <string>
+#include <random>
+#include <functional>
+
+/**
+ *
+ * Checks a faster JSON parser against the DOM parser it replaces on the responses the bridge really sends. Every response
+ * is parsed by both, and so are MutationsPerResponse copies of it with a few random edits (bytes replaced, dropped,
+ * inserted or repeated, the text cut short), which mostly give broken or unusual JSON the fast paths have to reject or
+ * hand over exactly like the DOM parser does. Every disagreement is printed to stderr with the text that caused it.
+*/
+class ParserVerifier {
+public:
+	/**
+	 * What a parser made of a text, written out so two parsers can be compared
+	 *
+	 * @param begin 		Text to parse
+	 * @param end 			End of the text
+	 * @param reference 	Parse it with the DOM parser instead of the one being checked
+	*/
+	typedef std::function<std::string(const char *begin, const char *end, bool reference)> Outcome;
+
+	static const int MutationsPerResponse = 8;
+
+	/**
+	 * @param seed 				Seed of the mutations (the same seed makes the same mutated copies)
+	 * @param mutationsPerResponse Mutated copies checked per response
+	*/
+	ParserVerifier(unsigned seed = 20210202, int mutationsPerResponse = MutationsPerResponse) :
+		responses(0),
+		mutations(0),
+		mismatches(0),
+		mutationsPerResponse(mutationsPerResponse),
+		random(seed) {}
+
+	// Check a response and mutated copies of it
+	void Verify(const char *begin, const char *end, const Outcome &outcome) {
+		responses++;
+		Compare(begin, end, outcome);
+
+		for (int i = 0; i < mutationsPerResponse; i++) {
+			mutated.assign(begin, end);
+			Mutate(mutated);
+			mutations++;
+			Compare(mutated.data(), mutated.data() + mutated.size(), outcome);
+		}
+	}
+
+	long responses;		// Responses checked
+	long mutations;		// Mutated copies checked
+	long mismatches;	// Texts the parsers disagreed on
+
+private:
+	void Compare(const char *begin, const char *end, const Outcome &outcome) {
+		std::string expected = outcome(begin, end, true);
+		std::string actual = outcome(begin, end, false);
+
+		if (expected != actual) {
+			mismatches++;
+			fprintf(stderr, "Function ParserVerifier::Verify: the parsers disagree on [%.*s]\n\tDOM: %s\n\tchecked parser: %s\n", (int) (end - begin), begin, expected.c_str(), actual.c_str());
+		}
+	}
+
+	void Mutate(std::string &text) {
+		// Mostly the characters JSON is made of, so the edits reach past the first syntax check
+		static const char alphabet[] = "{}[]:,\"\\ 0123456789-+.eEtrufalsn\x01\x7f\xc3\xa9";
+		int edits = 1 + random() % 3;
+
+		for (int i = 0; i < edits && !text.empty(); i++) {
+			size_t position = random() % text.size();
+			char c = alphabet[random() % (sizeof(alphabet) - 1)];
+
+			switch (random() % 5) {
+				case 0: text[position] = c; break;
+				case 1: text.erase(position, 1); break;
+				case 2: text.insert(position, 1, c); break;
+				case 3: text.resize(position); break;
+				default: {
+					// Repeat a piece of the text right after itself (repeated keys and members)
+					size_t length = 1 + random() % (text.size() - position);
+					text.insert(position + length, text, position, length);
+					break;
+				}
+			}
+		}
+	}
+
+	int mutationsPerResponse;
+	std::mt19937 random;
+	std::string mutated;	// Kept so its capacity is reused
+};
+
+#endif
@@ -0,0 +1,481 @@
+#ifndef PIPELINED_HTTP_CLIENT_H
+#define PIPELINED_HTTP_CLIENT_H
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "./ReceiveBuffer.h"
+
+// Describes one GET request sent through the PipelinedHTTPClient
+struct PipelinedRequest {
+	std::string path;				// Path to request, e.g. "/api/newdeveloper/lights/1"
+	ReceiveBuffer *responseString;	// The body is collected here (must be set; it keeps its capacity between requests)
+	std::chrono::steady_clock::time_point notBefore;	// The request is not written before this point in time (rate limiter)
+	int status;						// HTTP status code of the response (0 = no response)
+	bool done;						// A complete response was received
+
+	PipelinedRequest() : responseString(NULL), status(0), done(false) {}
+};
+
+/**
+ *
+ * Just enough HTTP/1.1 to GET small JSON documents from one host:port without libcurl. It keeps one connection alive over
+ * a non-blocking socket and writes all the requests of a batch to it back to back (pipelining), then reads the responses
+ * in the same order. Responses with a Content-Length, chunked responses and responses that end with the connection are
+ * understood; there is no TLS, no redirects, no compression and no conditional requests.
+ *
+ * All bytes are received into one buffer that is reused for every response, each body is copied out once. When the server
+ * closes the connection with requests still unanswered (e.g. it only answers a few per connection) the client reconnects
+ * and sends those again.
+*/
+class PipelinedHTTPClient {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	PipelinedHTTPClient(const std::string &host, int port) :
+		requests(0),
+		newConnections(0),
+		wireBytes(0),
+		decodedBytes(0),
+		host(host),
+		port(port),
+		fd(-1),
+		resolved(false),
+		addressLength(0),
+		written(0),
+		consumed(0),
+		closeAfter(false) {
+	}
+
+	~PipelinedHTTPClient() {
+		Close();
+	}
+
+	// Connect to a Unix domain socket instead of host:port (host:port is still sent in the Host header)
+	void SetUnixSocket(const std::string &path) {
+		Close();
+		unixSocket = path;
+		resolved = false;
+	}
+
+	/**
+	 *
+	 * GET one document.
+	 *
+	 * @param path 				Path to request
+	 * @param responseString 	String the body is collected in
+	 * @param deadline 			Give up when no complete response arrived by then
+	 * @return Bool 			False when no complete response came back
+	*/
+	bool Get(const std::string &path, ReceiveBuffer &responseString, Clock::time_point deadline) {
+		single.resize(1);
+		single[0].path = path;
+		single[0].responseString = &responseString;
+		single[0].notBefore = Clock::time_point();
+		return FetchAll(single, deadline) == 1;
+	}
+
+	/**
+	 *
+	 * Send a batch of GET requests pipelined on one connection and collect the responses.
+	 *
+	 * @param batch 		Requests to send, in order. Their status, done flag and response are filled in.
+	 * @param deadline 		Requests still unanswered by then are left not done (the connection is closed)
+	 * @return int 			Number of requests that got a complete response (a request the server closes the connection on
+	 * 						instead of answering is left not done, the requests behind it are sent again)
+	*/
+	int FetchAll(std::vector<PipelinedRequest> &batch, Clock::time_point deadline) {
+		for (size_t i = 0; i < batch.size(); i++) {
+			batch[i].status = 0;
+			batch[i].done = false;
+			if (batch[i].responseString) batch[i].responseString->Clear();
+		}
+
+		// Everything from the last batch was written (or its connection closed)
+		output.clear();
+		written = 0;
+
+		size_t answered = 0;	// Requests before this one have their response
+		size_t queued = 0;		// Requests before this one were written to the output buffer
+		bool retry = fd >= 0;	// A kept-alive connection may have been closed by the server in the meantime, so losing it
+								// without a response does not count against the request at the head of the line
+		long answeredBefore = 0;
+
+		while (answered < batch.size()) {
+			if (fd < 0) {
+				if (!Connect(deadline)) {
+					break;
+				}
+
+				// Everything that was not answered yet goes out again on the new connection
+				output.clear();
+				written = 0;
+				for (size_t i = answered; i < queued; i++) {
+					AppendRequest(batch[i].path);
+				}
+				answeredBefore = answered;
+			}
+
+			Clock::time_point now = Clock::now();
+			while (queued < batch.size() && batch[queued].notBefore <= now) {
+				AppendRequest(batch[queued++].path);
+			}
+
+			if (now >= deadline) {
+				fprintf(stderr, "PipelinedHTTPClient: timed out with %d of %d responses outstanding from %s:%d\n",
+					(int) (batch.size() - answered), (int) batch.size(), host.c_str(), port);
+				// Responses still on their way would be taken for the next batch's
+				Close();
+				break;
+			}
+
+			Clock::time_point wakeUp = deadline;
+			if (queued < batch.size() && batch[queued].notBefore < wakeUp) wakeUp = batch[queued].notBefore;
+			long waitMs = (long) std::chrono::duration_cast<std::chrono::milliseconds>(wakeUp - now).count() + 1;
+
+			pollfd p;
+			p.fd = fd;
+			p.events = POLLIN | (written < output.size() ? POLLOUT : 0);
+			p.revents = 0;
+
+			int ready = poll(&p, 1, (int) waitMs);
+			if (ready < 0 && errno != EINTR) {
+				fprintf(stderr, "PipelinedHTTPClient: poll() failed: %s\n", strerror(errno));
+				Close();
+				break;
+			}
+			if (ready <= 0) {
+				continue;
+			}
+
+			bool lost = false;
+
+			if (p.revents & POLLOUT) {
+				ssize_t sent = send(fd, output.data() + written, output.size() - written, MSG_NOSIGNAL);
+				if (sent > 0) {
+					written += sent;
+				} else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+					lost = true;
+				}
+			}
+
+			if (!lost && (p.revents & (POLLIN | POLLHUP | POLLERR))) {
+				// Receive straight into the end of the buffer
+				size_t used = input.size();
+				input.resize(used + ReadSize);
+				ssize_t received = recv(fd, &input[used], ReadSize, 0);
+				input.resize(used + (received > 0 ? received : 0));
+
+				if (received > 0) {
+					wireBytes += received;
+				} else if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+					lost = true;
+				}
+
+				// A response without a length ends with the connection
+				while (answered < queued && ParseResponse(batch[answered], lost)) {
+					answered++;
+				}
+				Compact();
+
+				// The server said it closes the connection after the last response (or sent something that is not one)
+				if (closeAfter) {
+					lost = true;
+				}
+			}
+
+			if (lost) {
+				Close();
+				if (!retry && (long) answered == answeredBefore && answered < queued) {
+					// Not a single response on this connection: give up on the request at the head of the line, the ones
+					// behind it get another connection
+					fprintf(stderr, "PipelinedHTTPClient: connection to %s:%d closed without a response to %s\n",
+						host.c_str(), port, batch[answered].path.c_str());
+					answered++;
+				}
+				retry = false;
+			}
+		}
+
+		int completed = 0;
+		for (size_t i = 0; i < batch.size(); i++) {
+			if (batch[i].done) completed++;
+		}
+		return completed;
+	}
+
+	// Close the connection (the next request opens a new one)
+	void Close() {
+		if (fd >= 0) {
+			close(fd);
+			fd = -1;
+		}
+		input.clear();
+		consumed = 0;
+		closeAfter = false;
+	}
+
+	long requests;			// Complete responses received
+	long newConnections;	// Connections opened
+	long long wireBytes;	// Bytes received, headers included
+	long long decodedBytes;	// Body bytes handed out
+
+private:
+	// Copying would close the socket twice
+	PipelinedHTTPClient(const PipelinedHTTPClient&);
+	PipelinedHTTPClient& operator=(const PipelinedHTTPClient&);
+
+	static const size_t ReadSize = 16384;
+
+	void AppendRequest(const std::string &path) {
+		output += "GET ";
+		output += path;
+		output += " HTTP/1.1\r\nHost: ";
+		output += host;
+		output += ":";
+		output += std::to_string(port);
+		output += "\r\nAccept: application/json\r\n\r\n";
+	}
+
+	bool Connect(Clock::time_point deadline) {
+		if (!resolved && !unixSocket.empty()) {
+			sockaddr_un *local = (sockaddr_un*) &address;
+			memset(local, 0, sizeof(sockaddr_un));
+			local->sun_family = AF_UNIX;
+			strncpy(local->sun_path, unixSocket.c_str(), sizeof(local->sun_path) - 1);
+			addressLength = sizeof(sockaddr_un);
+			resolved = true;
+		}
+
+		if (!resolved) {
+			addrinfo hints;
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+
+			addrinfo *result = NULL;
+			int error = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+			if (error != 0 || !result) {
+				fprintf(stderr, "PipelinedHTTPClient: unable to resolve %s: %s\n", host.c_str(), gai_strerror(error));
+				return false;
+			}
+
+			// Resolved once, reconnects go to the same address
+			memcpy(&address, result->ai_addr, result->ai_addrlen);
+			addressLength = result->ai_addrlen;
+			freeaddrinfo(result);
+			resolved = true;
+		}
+
+		fd = socket(address.ss_family, SOCK_STREAM, 0);
+		if (fd < 0) {
+			fprintf(stderr, "PipelinedHTTPClient: socket() failed: %s\n", strerror(errno));
+			return false;
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		if (address.ss_family != AF_UNIX) {
+			int on = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		}
+
+		int error = 0;
+		if (connect(fd, (sockaddr*) &address, addressLength) < 0) {
+			error = errno;
+			if (error == EINPROGRESS) {
+				pollfd p;
+				p.fd = fd;
+				p.events = POLLOUT;
+				p.revents = 0;
+
+				long waitMs = (long) std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+				if (poll(&p, 1, waitMs > 0 ? (int) waitMs : 0) == 1) {
+					socklen_t length = sizeof(error);
+					getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+				} else {
+					error = ETIMEDOUT;
+				}
+			}
+		}
+
+		if (error != 0) {
+			fprintf(stderr, "PipelinedHTTPClient: unable to connect to %s: %s\n",
+				unixSocket.empty() ? (host + ":" + std::to_string(port)).c_str() : unixSocket.c_str(), strerror(error));
+			Close();
+			return false;
+		}
+
+		newConnections++;
+		input.clear();
+		consumed = 0;
+		closeAfter = false;
+		return true;
+	}
+
+	// Find a header in the head of a response. value is set to the trimmed value of the header.
+	bool HeaderValue(size_t headStart, size_t headEnd, const char *name, std::string &value) const {
+		size_t nameLength = strlen(name);
+		size_t line = input.find("\r\n", headStart);
+
+		while (line != std::string::npos && line < headEnd) {
+			line += 2;
+			size_t lineEnd = input.find("\r\n", line);
+			if (lineEnd > headEnd) lineEnd = headEnd;
+
+			if (lineEnd - line > nameLength && input[line + nameLength] == ':' && strncasecmp(input.data() + line, name, nameLength) == 0) {
+				size_t start = line + nameLength + 1;
+				while (start < lineEnd && (input[start] == ' ' || input[start] == '\t')) start++;
+				size_t end = lineEnd;
+				while (end > start && (input[end - 1] == ' ' || input[end - 1] == '\t')) end--;
+				value.assign(input, start, end - start);
+				return true;
+			}
+			line = lineEnd;
+		}
+		return false;
+	}
+
+	/**
+	 *
+	 * Take the next response from the receive buffer when it is complete.
+	 *
+	 * @param request 	Request the response belongs to
+	 * @param ended 	The connection ended, a response without a length is complete
+	 * @return Bool 	True when the response was complete (the request is done)
+	*/
+	bool ParseResponse(PipelinedRequest &request, bool ended) {
+		while (true) {
+			size_t headEnd = input.find("\r\n\r\n", consumed);
+			if (headEnd == std::string::npos) {
+				return false;
+			}
+
+			if (input.compare(consumed, 7, "HTTP/1.") != 0 || headEnd - consumed < 12) {
+				fprintf(stderr, "PipelinedHTTPClient: unexpected response from %s:%d\n", host.c_str(), port);
+				closeAfter = true;
+				return false;
+			}
+
+			int status = atoi(input.c_str() + consumed + 9);
+			size_t bodyStart = headEnd + 4;
+
+			if (status / 100 == 1) {
+				// Interim response, the real one follows
+				consumed = bodyStart;
+				continue;
+			}
+
+			std::string value;
+			ReceiveBuffer &body = *request.responseString;
+			size_t end;
+			bool untilClose = false;
+
+			if (status == 204 || status == 304) {
+				body.Clear();
+				end = bodyStart;
+			} else if (HeaderValue(consumed, headEnd, "Transfer-Encoding", value) && strcasecmp(value.c_str(), "identity") != 0) {
+				// Chunked. The bodies are small, so the chunks are only decoded once they all arrived.
+				size_t position = bodyStart;
+				body.Clear();
+
+				while (true) {
+					size_t lineEnd = input.find("\r\n", position);
+					if (lineEnd == std::string::npos) {
+						body.Clear();
+						return false;
+					}
+
+					size_t size = strtoul(input.c_str() + position, NULL, 16);
+					position = lineEnd + 2;
+
+					if (size == 0) {
+						// Skip the trailers up to the empty line
+						if (input.compare(position, 2, "\r\n") == 0) {
+							end = position + 2;
+						} else {
+							end = input.find("\r\n\r\n", position);
+							if (end == std::string::npos) {
+								body.Clear();
+								return false;
+							}
+							end += 4;
+						}
+						break;
+					}
+
+					if (input.size() < position + size + 2) {
+						body.Clear();
+						return false;
+					}
+					body.Append(input.data() + position, size);
+					position += size + 2;
+				}
+			} else if (HeaderValue(consumed, headEnd, "Content-Length", value)) {
+				size_t length = strtoul(value.c_str(), NULL, 10);
+				if (input.size() < bodyStart + length) {
+					return false;
+				}
+				body.Assign(input.data() + bodyStart, length);
+				end = bodyStart + length;
+			} else {
+				if (!ended) {
+					return false;
+				}
+				body.Assign(input.data() + bodyStart, input.size() - bodyStart);
+				end = input.size();
+				untilClose = true;
+			}
+
+			if (untilClose || (HeaderValue(consumed, headEnd, "Connection", value) && strcasecmp(value.c_str(), "close") == 0)) {
+				closeAfter = true;
+			}
+
+			consumed = end;
+			request.status = status;
+			request.done = true;
+			requests++;
+			decodedBytes += body.Size();
+			return true;
+		}
+	}
+
+	// Drop the responses that were taken from the receive buffer
+	void Compact() {
+		if (consumed == input.size()) {
+			// Keeps the capacity
+			input.clear();
+			consumed = 0;
+		} else if (consumed > input.size() / 2) {
+			input.erase(0, consumed);
+			consumed = 0;
+		}
+	}
+
+	std::string host;
+	int port;
+	std::string unixSocket;		// Socket to connect to instead of host:port ("" = TCP)
+	int fd;						// Socket of the connection (-1 = not connected)
+	bool resolved;
+	sockaddr_storage address;	// Address the hostname resolved to
+	socklen_t addressLength;
+	std::string output;			// Requests to write
+	size_t written;				// Bytes of output written so far
+	std::string input;			// Bytes received and not yet taken by a response
+	size_t consumed;			// Bytes at the start of input that belong to responses already taken
+	bool closeAfter;			// The last response said the connection closes after it
+	std::vector<PipelinedRequest> single;	// Batch of Get()
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+#include <chrono>
+#include <thread>
+
+/**
+ *
+ * Token bucket that keeps the requests to a bridge under the rate it throttles at (a real Hue bridge handles about 10 per
+ * second). The bucket holds up to burst tokens and refills at rate tokens per second; every request takes one.
+ *
+ * A request that finds the bucket empty is not dropped: Reserve() hands out the token that will be refilled next, so the
+ * requests wait in line in the order they asked and the bridge never sees more than the rate (plus the burst).
+*/
+class RateLimiter {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	 *
+	 * @param ratePerSecond 	Tokens added per second (0 = no limit)
+	 * @param burst 			Tokens the bucket holds, the requests that may go out back to back
+	*/
+	RateLimiter(double ratePerSecond, int burst) :
+		rate(ratePerSecond),
+		burst(burst < 1 ? 1 : burst),
+		requests(0),
+		delayed(0),
+		totalWaitMs(0),
+		maxWaitMs(0),
+		tokens(burst < 1 ? 1 : burst),
+		refilled(Clock::now()) {
+	}
+
+	bool Enabled() const {
+		return rate > 0;
+	}
+
+	/**
+	 *
+	 * Take a token for one request.
+	 *
+	 * @return time_point 	When the request may go out (now or earlier when a token was available)
+	*/
+	Clock::time_point Reserve() {
+		Clock::time_point now = Clock::now();
+		requests++;
+
+		if (!Enabled()) {
+			return now;
+		}
+
+		tokens += std::chrono::duration<double>(now - refilled).count() * rate;
+		if (tokens > burst) tokens = burst;
+		refilled = now;
+
+		// Tokens go negative while requests wait in line, each one waits for its own token to be refilled
+		tokens -= 1;
+		if (tokens >= 0) {
+			return now;
+		}
+
+		double waitSeconds = -tokens / rate;
+		double waitMs = waitSeconds * 1000;
+		delayed++;
+		totalWaitMs += waitMs;
+		if (waitMs > maxWaitMs) maxWaitMs = waitMs;
+
+		return now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(waitSeconds));
+	}
+
+	// Block the calling thread until it may send a request
+	void Acquire() {
+		std::this_thread::sleep_until(Reserve());
+	}
+
+	double AverageWaitMs() const {
+		return requests ? totalWaitMs / requests : 0;
+	}
+
+	double rate;
+	int burst;
+
+	long requests;			// Tokens handed out
+	long delayed;			// Of which had to wait for the bucket to refill
+	double totalWaitMs;		// Sum of the time requests waited in line
+	double maxWaitMs;		// Longest wait
+
+private:
+	double tokens;				// Tokens in the bucket (negative = requests waiting in line)
+	Clock::time_point refilled;	// Last time tokens were added
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef RECEIVE_BUFFER_H
+#define RECEIVE_BUFFER_H
+#include <stddef.h>
+#include <string.h>
+#include <utility>
+
+/**
+ *
+ * Buffer a response body is received into. Clearing it keeps its memory, so once a buffer has grown to the size of the
+ * responses it receives, later requests (and samples) append into it without allocating. The parser reads the bytes in
+ * place through Begin() / End().
+ *
+ * Every time the buffer has to grow it counts an allocation, so the allocations of a sample can be checked to be 0 once
+ * the program has warmed up.
+*/
+class ReceiveBuffer {
+public:
+	ReceiveBuffer() : allocations(0), data(NULL), size(0), capacity(0) {}
+
+	ReceiveBuffer(const ReceiveBuffer &other) : allocations(0), data(NULL), size(0), capacity(0) {
+		Assign(other.data, other.size);
+	}
+
+	ReceiveBuffer(ReceiveBuffer &&other) noexcept : allocations(other.allocations), data(other.data), size(other.size), capacity(other.capacity) {
+		other.data = NULL;
+		other.size = 0;
+		other.capacity = 0;
+	}
+
+	ReceiveBuffer& operator=(ReceiveBuffer other) {
+		Swap(other);
+		return *this;
+	}
+
+	~ReceiveBuffer() {
+		delete[] data;
+	}
+
+	void Append(const char *bytes, size_t length) {
+		Reserve(size + length);
+		memcpy(data + size, bytes, length);
+		size += length;
+	}
+
+	void Assign(const char *bytes, size_t length) {
+		size = 0;
+		Append(bytes, length);
+	}
+
+	// Forget the contents, the memory is kept for the next response
+	void Clear() {
+		size = 0;
+	}
+
+	void Swap(ReceiveBuffer &other) {
+		std::swap(allocations, other.allocations);
+		std::swap(data, other.data);
+		std::swap(size, other.size);
+		std::swap(capacity, other.capacity);
+	}
+
+	const char* Data() const {
+		return data ? data : "";
+	}
+
+	const char* Begin() const {
+		return Data();
+	}
+
+	const char* End() const {
+		return Data() + size;
+	}
+
+	size_t Size() const {
+		return size;
+	}
+
+	bool Empty() const {
+		return size == 0;
+	}
+
+	long allocations;	// Times the buffer had to grow
+
+private:
+	void Reserve(size_t needed) {
+		if (needed <= capacity) {
+			return;
+		}
+
+		// Grow by at least half, so a body received in many small chunks does not allocate for every chunk
+		size_t grown = capacity + capacity / 2;
+		if (grown < needed) grown = needed;
+		if (grown < 1024) grown = 1024;
+
+		char *bigger = new char[grown];
+		if (size > 0) memcpy(bigger, data, size);
+		delete[] data;
+
+		data = bigger;
+		capacity = grown;
+		allocations++;
+	}
+
+	char *data;
+	size_t size;
+	size_t capacity;
+};
+
+#endif
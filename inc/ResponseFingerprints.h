@@ -0,0 +1,119 @@
+#ifndef RESPONSE_FINGERPRINTS_H
+#define RESPONSE_FINGERPRINTS_H
+#include <string>
+#include <map>
+#include <stdint.h>
+#include <string.h>
+#include "./HUELightSimulator.h"
+
+/**
+ *
+ * Fast 64-bit hash of a response body. Reads 8 bytes per step and mixes them with a multiply and shift, so hashing a body
+ * costs a fraction of parsing it. Not meant to resist deliberate collisions, only to tell whether a body changed.
+ *
+ * @param data 		Bytes to hash
+ * @param length 	Number of bytes
+ * @return uint64_t Fingerprint of the bytes
+*/
+inline uint64_t FingerprintResponse(const char *data, size_t length) {
+	const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+	uint64_t hash = 0xCBF29CE484222325ULL ^ (length * multiplier);
+	size_t i = 0;
+
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * multiplier;
+		hash ^= hash >> 29;
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, data + i, length - i);
+	hash = (hash ^ tail) * multiplier;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+inline uint64_t FingerprintResponse(const ReceiveBuffer &response) {
+	return FingerprintResponse(response.Data(), response.Size());
+}
+
+/**
+ *
+ * Remembers the fingerprints of the responses from the last sample, along with what they were parsed into, so a body that
+ * comes back byte-identical can skip json::parse and CompareAndUpdateLightStates.
+*/
+struct ResponseFingerprints {
+	uint64_t collection;		// Fingerprint of the last "Query all" response
+	bool hasCollection;			// collection holds a fingerprint
+	int collectionElements;		// Number of lights in the last "Query all" response
+	std::map<int, std::pair<uint64_t, HueLight> > lights;	// Fingerprint and parsed light of the last response per light ID
+	int sampleMisses;			// Individual light responses that changed during the current sample
+	long hits;					// Responses that were unchanged and skipped
+	long checks;				// Responses that were checked
+
+	ResponseFingerprints() : collection(0), hasCollection(false), collectionElements(0), sampleMisses(0), hits(0), checks(0) {}
+
+	/**
+	 *
+	 * Check the "Query all" response against the last one and remember it.
+	 *
+	 * @return Bool 	True when it is byte-identical to the last one
+	*/
+	bool CollectionUnchanged(const ReceiveBuffer &response) {
+		uint64_t fingerprint = FingerprintResponse(response);
+		bool unchanged = hasCollection && fingerprint == collection;
+
+		checks++;
+		if (unchanged) hits++;
+
+		collection = fingerprint;
+		hasCollection = true;
+		return unchanged;
+	}
+
+	// Forget the "Query all" response, so a body that could not be used is never mistaken for unchanged
+	void ForgetCollection() {
+		hasCollection = false;
+	}
+
+	/**
+	 *
+	 * Look up an individual light response. On a hit, light is set to what the same body was parsed into last time.
+	 *
+	 * @param id 			ID of the light
+	 * @param fingerprint 	Fingerprint of the response (see FingerprintResponse)
+	 * @param light 		Set to the remembered light on a hit
+	 * @return Bool 		True when the response is byte-identical to the last one for this light
+	*/
+	bool FindLight(int id, uint64_t fingerprint, HueLight &light) {
+		checks++;
+
+		std::map<int, std::pair<uint64_t, HueLight> >::const_iterator it = lights.find(id);
+		if (it != lights.end() && it->second.first == fingerprint) {
+			hits++;
+			light = it->second.second;
+			return true;
+		}
+
+		sampleMisses++;
+		return false;
+	}
+
+	// Remember what a changed light response was parsed into
+	void RememberLight(int id, uint64_t fingerprint, const HueLight &light) {
+		lights[id] = std::make_pair(fingerprint, light);
+	}
+
+	// Forget a light whose response could not be used, so it is never mistaken for unchanged
+	void ForgetLight(int id) {
+		lights.erase(id);
+	}
+
+	double HitRate() const {
+		return checks == 0 ? 0 : (double) hits / checks;
+	}
+};
+
+#endif
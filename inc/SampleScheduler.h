@@ -0,0 +1,119 @@
+#ifndef SAMPLE_SCHEDULER_H
+#define SAMPLE_SCHEDULER_H
+#include <chrono>
+#include <thread>
+
+/**
+ *
+ * Keeps samples on a fixed grid of absolute deadlines (start, start + interval, start + 2 * interval, ...) instead of
+ * sleeping a fixed time after each sample, so the time a sample takes does not push every later sample back.
+ *
+ * When a sample runs past one or more deadlines (an overrun) the scheduler either skips the missed deadlines and waits for
+ * the next one on the grid, or catches up by starting the missed samples right away, one after another.
+ * It also measures how far each sample started from its deadline (jitter) and the rate that was actually achieved.
+*/
+class SampleScheduler {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	 *
+	 * @param intervalMicroseconds 	Time between two deadlines
+	 * @param catchUp 				On an overrun, start the missed samples right away instead of skipping them
+	*/
+	SampleScheduler(long intervalMicroseconds, bool catchUp) :
+		interval(std::chrono::microseconds(intervalMicroseconds > 0 ? intervalMicroseconds : 1)),
+		catchUp(catchUp),
+		started(false),
+		samples(0),
+		skipped(0),
+		totalJitterMs(0),
+		maxJitterMs(0) {
+	}
+
+	// Deadline of the next sample (now when no sample was started yet)
+	Clock::time_point Due() const {
+		return started ? due : Clock::now();
+	}
+
+	// Block the calling thread until the next sample is due
+	void WaitUntilDue() const {
+		std::this_thread::sleep_until(Due());
+	}
+
+	/**
+	 *
+	 * Change the time between samples. The next deadline moves to one new interval after the start of the last sample.
+	 *
+	 * @param intervalMicroseconds 	New time between two deadlines
+	*/
+	void SetInterval(long intervalMicroseconds) {
+		interval = std::chrono::microseconds(intervalMicroseconds > 0 ? intervalMicroseconds : 1);
+		if (started) {
+			due = last + interval;
+		}
+	}
+
+	/**
+	 *
+	 * Record that a sample started and move the deadline to the next one on the grid.
+	 *
+	 * @param now 	Time the sample started
+	*/
+	void Started(Clock::time_point now) {
+		if (!started) {
+			started = true;
+			first = now;
+			last = now;
+			due = now;
+		}
+		previous = last;
+		last = now;
+
+		double jitterMs = std::chrono::duration<double, std::milli>(now - due).count();
+		if (jitterMs < 0) jitterMs = -jitterMs;
+		totalJitterMs += jitterMs;
+		if (jitterMs > maxJitterMs) maxJitterMs = jitterMs;
+		samples++;
+
+		due += interval;
+
+		if (!catchUp && due <= now) {
+			// Overrun: drop the deadlines that already passed and stay on the grid
+			long missed = (long) ((now - due) / interval) + 1;
+			due += missed * interval;
+			skipped += missed;
+		}
+	}
+
+	// Samples per minute actually started, measured from the first to the last sample started
+	double AchievedPerMinute() const {
+		if (samples < 2) return 0;
+		double minutes = std::chrono::duration<double>(last - first).count() / 60.0;
+		return minutes > 0 ? (samples - 1) / minutes : 0;
+	}
+
+	// Samples per minute the current interval asks for
+	double RequestedPerMinute() const {
+		return 60.0 * 1000000.0 / std::chrono::duration_cast<std::chrono::microseconds>(interval).count();
+	}
+
+	double AverageJitterMs() const {
+		return samples ? totalJitterMs / samples : 0;
+	}
+
+	Clock::duration interval;
+	bool catchUp;
+
+	bool started;
+	Clock::time_point first;	// Start of the first sample
+	Clock::time_point last;		// Start of the last sample
+	Clock::time_point previous;	// Start of the sample before the last one (same as last after the first sample)
+	Clock::time_point due;		// Deadline of the next sample
+	long samples;				// Samples started
+	long skipped;				// Deadlines skipped because of overruns
+	double totalJitterMs;		// Sum of how late (or early) every sample started
+	double maxJitterMs;			// Worst jitter
+};
+
+#endif
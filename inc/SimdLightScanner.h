@@ -0,0 +1,531 @@
+#ifndef SIMD_LIGHT_SCANNER_H
+#define SIMD_LIGHT_SCANNER_H
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "./HUELightSimulator.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_LIGHT_SCANNER_X86
+#endif
+
+/**
+ *
+ * Two pass parser for large "Query all" responses. The first pass classifies the text 64 bytes at a time with vector
+ * instructions and writes down where every token starts (a structural index): braces, brackets, colons, commas, both
+ * quotes of every string and the first byte of every number or literal. The second pass walks that index instead of the
+ * bytes, picking out the light objects and their name, state.on and state.bri, and checking the JSON grammar of
+ * everything it skips on the way.
+ *
+ * The first pass is built for AVX2, for SSE4.2 (PCMPESTRM finds the structural characters) and for plain C++. The best
+ * kernel the CPU supports is picked at runtime, or one can be picked by name.
+ *
+ * Like LightSchemaParser, it only handles the plain case. It gives up (returns false) on a backslash, a control character
+ * or a byte outside ASCII anywhere in the text, and on everything LightSchemaParser gives up on. The caller then parses
+ * the response some other way.
+*/
+class SimdLightScanner {
+public:
+	enum Kernel { Scalar, SSE42, AVX2 };
+
+	static const int MaxDepth = 64;		// Deepest nesting of skipped values handled
+	static const int MaxId = 65536;		// IDs handled in a collection (a bridge holds at most 63 lights, emulators many more)
+
+	SimdLightScanner() : kernel(BestKernel()), scannedBytes(0), scanNs(0), text(NULL), textEnd(NULL), next(NULL), last(NULL) {}
+
+	// Best kernel the CPU runs
+	static Kernel BestKernel() {
+#ifdef SIMD_LIGHT_SCANNER_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return AVX2;
+		if (__builtin_cpu_supports("sse4.2")) return SSE42;
+#endif
+		return Scalar;
+	}
+
+	/**
+	 *
+	 * @param name 		"auto", "avx2", "sse4.2" or "scalar"
+	 * @param kernel 	Set to the kernel
+	 * @return Bool 	False when the name is unknown or the CPU does not run that kernel
+	*/
+	static bool KernelFromName(const std::string &name, Kernel &kernel) {
+		Kernel best = BestKernel();
+
+		if (name == "auto") kernel = best;
+		else if (name == "avx2") kernel = AVX2;
+		else if (name == "sse4.2") kernel = SSE42;
+		else if (name == "scalar") kernel = Scalar;
+		else return false;
+
+		return kernel <= best;
+	}
+
+	static const char* KernelName(Kernel kernel) {
+		switch (kernel) {
+			case AVX2: return "avx2";
+			case SSE42: return "sse4.2";
+			default: return "scalar";
+		}
+	}
+
+	/**
+	 *
+	 * @param id 		ID of the light (the key it is stored under on the server)
+	 * @param light 	Set to the parsed light
+	 * @return Bool 	False when the response has to be parsed some other way
+	*/
+	bool ParseLight(const char *begin, const char *end, int id, HueLight &light) {
+		if (!Index(begin, end)) return false;
+		return LightObject(id, light) && next == last;
+	}
+
+	/**
+	 *
+	 * @param elements 	Set to the number of members of the collection
+	 * @param lights 	When not NULL, set to the lights of the collection (sorted by ID)
+	 * @return Bool 	False when the response has to be parsed some other way
+	*/
+	bool ParseCollection(const char *begin, const char *end, int &elements, std::vector<HueLight> *lights) {
+		if (!Index(begin, end)) return false;
+
+		std::vector<HueLight> found;
+		if (!Collection(elements, lights ? &found : NULL)) return false;
+
+		if (lights) {
+			std::sort(found.begin(), found.end(), [](const HueLight &a, const HueLight &b) { return a.id < b.id; });
+			lights->swap(found);
+		}
+		return true;
+	}
+
+	Kernel kernel;
+	long long scannedBytes;		// Bytes the first pass went through
+	double scanNs;				// Time the first pass took
+
+private:
+	// What the 64 bytes of a block are, one bit per byte
+	struct Block {
+		uint64_t quote;
+		uint64_t backslash;
+		uint64_t op;			// { } [ ] : ,
+		uint64_t whitespace;	// space \t \n \r
+		uint64_t control;		// below 0x20 or 0x80 and above
+	};
+
+	// First pass: the structural index of the text
+	bool Index(const char *begin, const char *end) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t length = end - begin;
+		bool ok = true;
+
+		text = begin;
+		textEnd = end;
+
+		// A byte starts at most one token, so the index is written without checking its size
+		if (index.size() < length + 64) index.resize(length + 64);
+		uint32_t *out = index.data();
+
+		uint64_t inStringBefore = 0;	// All ones when the last block ended inside a string
+		uint64_t scalarBefore = 0;		// The last block ended inside a number or literal
+
+		for (size_t offset = 0; offset < length && ok; offset += 64) {
+			const char *block = begin + offset;
+			char padded[64];
+
+			if (length - offset < 64) {
+				// The end of the text, padded with whitespace
+				memset(padded, ' ', sizeof(padded));
+				memcpy(padded, block, length - offset);
+				block = padded;
+			}
+
+			Block bits;
+			switch (kernel) {
+#ifdef SIMD_LIGHT_SCANNER_X86
+				case AVX2: ClassifyAVX2(block, bits); break;
+				case SSE42: ClassifySSE42(block, bits); break;
+#endif
+				default: ClassifyScalar(block, bits); break;
+			}
+
+			// Inside a string is everything from an opening quote up to (not including) its closing quote
+			uint64_t inString = PrefixXor(bits.quote) ^ inStringBefore;
+			inStringBefore = (uint64_t) ((int64_t) inString >> 63);
+
+			// Escapes are left to the other parsers, and so are bytes JSON does not allow or this parser does not check
+			uint64_t unusual = bits.backslash | (bits.control & ~bits.whitespace) | (bits.control & bits.whitespace & inString);
+			if (unusual) {
+				ok = false;
+				break;
+			}
+
+			uint64_t scalar = ~(bits.op | bits.whitespace | bits.quote) & ~inString;
+			uint64_t scalarStart = scalar & ~((scalar << 1) | scalarBefore);
+			scalarBefore = scalar >> 63;
+
+			uint64_t structural = (bits.op & ~inString) | bits.quote | scalarStart;
+			while (structural) {
+				*out++ = (uint32_t) (offset + __builtin_ctzll(structural));
+				structural &= structural - 1;
+			}
+		}
+
+		// A string that is not closed
+		if (inStringBefore) ok = false;
+
+		next = index.data();
+		last = out;
+
+		scannedBytes += length;
+		scanNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		return ok;
+	}
+
+	// Every bit that has an odd number of set bits at or below it
+	static uint64_t PrefixXor(uint64_t bits) {
+		bits ^= bits << 1;
+		bits ^= bits << 2;
+		bits ^= bits << 4;
+		bits ^= bits << 8;
+		bits ^= bits << 16;
+		bits ^= bits << 32;
+		return bits;
+	}
+
+	static void ClassifyScalar(const char *block, Block &bits) {
+		memset(&bits, 0, sizeof(bits));
+
+		for (int i = 0; i < 64; i++) {
+			unsigned char c = block[i];
+			uint64_t bit = 1ULL << i;
+
+			switch (c) {
+				case '"': bits.quote |= bit; break;
+				case '\\': bits.backslash |= bit; break;
+				case '{': case '}': case '[': case ']': case ':': case ',': bits.op |= bit; break;
+				case ' ': case '\t': case '\n': case '\r': bits.whitespace |= bit; break;
+				default: break;
+			}
+			if (c < 0x20 || c >= 0x80) bits.control |= bit;
+		}
+	}
+
+#ifdef SIMD_LIGHT_SCANNER_X86
+	__attribute__((target("sse4.2")))
+	static void ClassifySSE42(const char *block, Block &bits) {
+		const __m128i ops = _mm_setr_epi8('{', '}', '[', ']', ':', ',', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m128i spaces = _mm_setr_epi8(' ', '\t', '\n', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i space = _mm_set1_epi8(0x20);
+		const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK;
+
+		memset(&bits, 0, sizeof(bits));
+
+		for (int i = 0; i < 4; i++) {
+			__m128i v = _mm_loadu_si128((const __m128i*) (block + 16 * i));
+			int shift = 16 * i;
+
+			// Any of the 6 (or 4) characters, explicit lengths so a NUL byte does not end the block
+			bits.op |= (uint64_t) (_mm_cvtsi128_si32(_mm_cmpestrm(ops, 6, v, 16, mode)) & 0xffff) << shift;
+			bits.whitespace |= (uint64_t) (_mm_cvtsi128_si32(_mm_cmpestrm(spaces, 4, v, 16, mode)) & 0xffff) << shift;
+			bits.quote |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+			bits.backslash |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << shift;
+			// Signed: the bytes from 0x80 are negative, so they count as below 0x20 too
+			bits.control |= (uint64_t) _mm_movemask_epi8(_mm_cmplt_epi8(v, space)) << shift;
+		}
+	}
+
+	__attribute__((target("avx2")))
+	static void ClassifyAVX2(const char *block, Block &bits) {
+		const __m256i quote = _mm256_set1_epi8('"');
+		const __m256i backslash = _mm256_set1_epi8('\\');
+		const __m256i space = _mm256_set1_epi8(0x20);
+
+		memset(&bits, 0, sizeof(bits));
+
+		for (int i = 0; i < 2; i++) {
+			__m256i v = _mm256_loadu_si256((const __m256i*) (block + 32 * i));
+			int shift = 32 * i;
+
+			__m256i op = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))),
+				_mm256_or_si256(
+					_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']'))),
+					_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')))));
+			__m256i whitespace = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+
+			bits.op |= (uint64_t) (uint32_t) _mm256_movemask_epi8(op) << shift;
+			bits.whitespace |= (uint64_t) (uint32_t) _mm256_movemask_epi8(whitespace) << shift;
+			bits.quote |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+			bits.backslash |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << shift;
+			// Signed: the bytes from 0x80 are negative, so they count as below 0x20 too
+			bits.control |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(space, v)) << shift;
+		}
+	}
+#endif
+
+	// Second pass, over the index. The text between two tokens is whitespace (or the rest of a number or literal)
+
+	bool Collection(int &elements, std::vector<HueLight> *lights) {
+		// The DOM counts repeated keys once: give up on them
+		uint64_t seen[MaxId / 64];
+		memset(seen, 0, sizeof(seen));
+		int count = 0;
+
+		if (!Consume('{')) return false;
+
+		if (!Consume('}')) {
+			for (;;) {
+				const char *key;
+				size_t keyLength;
+				int id;
+
+				if (!Key(key, keyLength) || !Id(key, keyLength, id)) return false;
+				if (seen[id / 64] & (1ULL << (id % 64))) return false;
+				seen[id / 64] |= 1ULL << (id % 64);
+				count++;
+
+				if (lights) {
+					HueLight light;
+					if (!LightObject(id, light)) return false;
+					lights->push_back(std::move(light));
+				} else if (!SkipValue(1)) {
+					return false;
+				}
+
+				if (Consume('}')) break;
+				if (!Consume(',')) return false;
+			}
+		}
+
+		if (next != last) return false;
+
+		elements = count;
+		return true;
+	}
+
+	bool LightObject(int id, HueLight &light) {
+		const char *name = NULL;
+		size_t nameLength = 0;
+		bool haveState = false;
+		bool on = false, haveOn = false;
+		int bri = 0;
+		bool haveBri = false;
+
+		if (!Consume('{')) return false;
+		if (Consume('}')) return false;
+
+		for (;;) {
+			const char *key;
+			size_t keyLength;
+
+			if (!Key(key, keyLength)) return false;
+
+			if (Is(key, keyLength, "name")) {
+				if (name) return false;
+				if (!String(name, nameLength)) return false;
+			} else if (Is(key, keyLength, "state")) {
+				if (haveState) return false;
+				haveState = true;
+				if (!State(on, haveOn, bri, haveBri)) return false;
+			} else if (!SkipValue(1)) {
+				return false;
+			}
+
+			if (Consume('}')) break;
+			if (!Consume(',')) return false;
+		}
+
+		if (!name || !haveOn || !haveBri) return false;
+
+		light.id = id;
+		light.name.assign(name, nameLength);
+		light.on = on;
+		SetLightBrightness(light, bri);
+		light.isValid = true;
+		light.stale = false;
+		return true;
+	}
+
+	bool State(bool &on, bool &haveOn, int &bri, bool &haveBri) {
+		if (!Consume('{')) return false;
+		if (Consume('}')) return false;
+
+		for (;;) {
+			const char *key;
+			size_t keyLength;
+
+			if (!Key(key, keyLength)) return false;
+
+			if (Is(key, keyLength, "on")) {
+				if (haveOn) return false;
+				haveOn = true;
+				const char *token;
+				size_t tokenLength;
+				if (!Token(token, tokenLength)) return false;
+				if (Is(token, tokenLength, "true")) on = true;
+				else if (Is(token, tokenLength, "false")) on = false;
+				else return false;
+			} else if (Is(key, keyLength, "bri")) {
+				if (haveBri) return false;
+				haveBri = true;
+				if (!Integer(bri)) return false;
+			} else if (!SkipValue(2)) {
+				return false;
+			}
+
+			if (Consume('}')) return true;
+			if (!Consume(',')) return false;
+		}
+	}
+
+	// A key and the colon after it, the value is next
+	bool Key(const char *&key, size_t &length) {
+		return String(key, length) && Consume(':');
+	}
+
+	// Both quotes of a string are in the index (and the first pass made sure it holds nothing to check)
+	bool String(const char *&start, size_t &length) {
+		if (next + 1 >= last || text[*next] != '"') return false;
+		start = text + *next + 1;
+		length = next[1] - next[0] - 1;
+		next += 2;
+		return true;
+	}
+
+	// A number or literal: the token runs until whitespace or the next token
+	bool Token(const char *&token, size_t &length) {
+		if (next == last || IsStructural(text[*next])) return false;
+		token = text + *next;
+		next++;
+
+		// Only whitespace can come between the end of the token and the next one (anything else would be a token too)
+		const char *tokenEnd = next == last ? textEnd : text + *next;
+		length = 0;
+		while (token + length < tokenEnd && !IsWhitespace(token[length])) length++;
+		return true;
+	}
+
+	// A whole number small enough for an int (bri)
+	bool Integer(int &value) {
+		const char *token;
+		size_t length;
+		if (!Token(token, length)) return false;
+
+		size_t i = token[0] == '-' ? 1 : 0;
+		size_t digits = length - i;
+		if (digits == 0 || digits > 9 || (token[i] == '0' && digits > 1)) return false;
+
+		long number = 0;
+		for (; i < length; i++) {
+			if (token[i] < '0' || token[i] > '9') return false;
+			number = number * 10 + (token[i] - '0');
+		}
+
+		value = (int) (token[0] == '-' ? -number : number);
+		return true;
+	}
+
+	// The key of a collection member as a light ID
+	bool Id(const char *key, size_t length, int &id) {
+		if (length == 0 || length > 5 || (key[0] == '0' && length > 1)) return false;
+
+		id = 0;
+		for (size_t i = 0; i < length; i++) {
+			if (key[i] < '0' || key[i] > '9') return false;
+			id = id * 10 + (key[i] - '0');
+		}
+		return id < MaxId;
+	}
+
+	// Any JSON value, checked but not kept
+	bool SkipValue(int depth) {
+		if (depth > MaxDepth || next == last) return false;
+
+		char c = text[*next];
+		if (c == '{' || c == '[') {
+			char close = c == '{' ? '}' : ']';
+			next++;
+			if (Consume(close)) return true;
+
+			for (;;) {
+				if (close == '}') {
+					const char *key;
+					size_t keyLength;
+					if (!Key(key, keyLength)) return false;
+				}
+				if (!SkipValue(depth + 1)) return false;
+				if (Consume(close)) return true;
+				if (!Consume(',')) return false;
+			}
+		}
+
+		if (c == '"') {
+			const char *string;
+			size_t length;
+			return String(string, length);
+		}
+
+		const char *token;
+		size_t length;
+		if (!Token(token, length)) return false;
+		return Is(token, length, "true") || Is(token, length, "false") || Is(token, length, "null") || IsNumber(token, length);
+	}
+
+	// -?(0|[1-9][0-9]*)(.[0-9]+)? (an exponent or a number too long for a double is left to the other parsers)
+	static bool IsNumber(const char *token, size_t length) {
+		size_t i = 0;
+		if (length >= 300) return false;
+		if (i < length && token[i] == '-') i++;
+
+		if (i < length && token[i] == '0') {
+			i++;
+		} else if (i < length && token[i] >= '1' && token[i] <= '9') {
+			while (i < length && token[i] >= '0' && token[i] <= '9') i++;
+		} else {
+			return false;
+		}
+
+		if (i < length && token[i] == '.') {
+			size_t digits = ++i;
+			while (i < length && token[i] >= '0' && token[i] <= '9') i++;
+			if (i == digits) return false;
+		}
+		return i == length;
+	}
+
+	static bool IsStructural(char c) {
+		return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',' || c == '"';
+	}
+
+	static bool IsWhitespace(char c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+
+	static bool Is(const char *key, size_t length, const char *name) {
+		return strlen(name) == length && memcmp(key, name, length) == 0;
+	}
+
+	bool Consume(char c) {
+		if (next < last && text[*next] == c) {
+			next++;
+			return true;
+		}
+		return false;
+	}
+
+	std::vector<uint32_t> index;	// Offsets of the tokens (kept so its memory is reused, only the start up to last is used)
+	const char *text;
+	const char *textEnd;
+	const uint32_t *next;			// Next token
+	const uint32_t *last;			// End of the index
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef STREAMING_LIGHT_PARSER_H
+#define STREAMING_LIGHT_PARSER_H
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "./HUELightSimulator.h"
+#include "./LightSchemaParser.h"
+
+/**
+ *
+ * Parses the "Query all" collection while it is still being received. It is fed the response received so far every
+ * time a piece of it arrives (from the write callback of the transfer) and parses every member of the collection that
+ * is complete by then, so each light is ready as soon as its object closes and little is left to do once the transfer
+ * is over. A member cut off at the end of what has arrived is parsed again from its start when more text comes in.
+ *
+ * The members are parsed by LightSchemaParser, so it handles the same plain responses and gives up on the same ones
+ * (and on a repeated ID). Finish() then returns false and the caller parses the whole response some other way.
+*/
+class StreamingLightParser {
+public:
+	static const int MaxId = LightSchemaParser::MaxId;
+
+	StreamingLightParser() :
+		transfers(0),
+		responses(0),
+		gaveUp(0),
+		lightsParsed(0),
+		lightsEarly(0),
+		receiveNs(0),
+		seen(MaxId / 64) {
+		Reset(false);
+	}
+
+	/**
+	 *
+	 * Start a new response.
+	 *
+	 * @param keep 	Keep the lights (otherwise the members are only counted)
+	*/
+	void Reset(bool keep) {
+		keepLights = keep;
+		state = Opening;
+		offset = 0;
+		received = 0;
+		count = 0;
+		countBefore = 0;
+		lights.clear();
+		std::fill(seen.begin(), seen.end(), 0);
+	}
+
+	/**
+	 *
+	 * Parse what can be parsed of the response received so far.
+	 *
+	 * @param begin 	The response received so far (it only grows between calls, but may have been moved)
+	 * @param end 		End of the response received so far
+	*/
+	void Feed(const char *begin, const char *end) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		if (received == 0) transfers++;
+		countBefore = count;
+		received = end - begin;
+		Parse(begin, end);
+
+		receiveNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	/**
+	 *
+	 * The transfer is over: take the result.
+	 *
+	 * @param begin 	The whole response (the one that was fed, e.g. not a cached body put in its place)
+	 * @param end 		End of the response
+	 * @param elements 	Set to the number of members of the collection
+	 * @param lights 	When not NULL, set to the lights of the collection (sorted by ID)
+	 * @return Bool 	False when the response has to be parsed some other way
+	*/
+	bool Finish(const char *begin, const char *end, int &elements, std::vector<HueLight> *lights) {
+		// Only what arrived through Feed() was parsed
+		bool ok = state == Closed && received == (size_t) (end - begin) && LightSchemaParser(begin + offset, end).Finished();
+		ok = ok && (!lights || keepLights);
+
+		if (ok) {
+			elements = count;
+			if (lights) {
+				std::sort(this->lights.begin(), this->lights.end(), [](const HueLight &a, const HueLight &b) { return a.id < b.id; });
+				lights->swap(this->lights);
+			}
+			responses++;
+			lightsParsed += count;
+			// Only the members the last piece of the response completed were left when the transfer ended
+			lightsEarly += countBefore;
+		} else {
+			gaveUp++;
+		}
+		return ok;
+	}
+
+	long transfers;			// Responses fed (some are never taken, e.g. when the collection did not change)
+	long responses;			// Responses parsed while they were received
+	long gaveUp;			// Responses left to the other parsers
+	long lightsParsed;		// Members of those responses
+	long lightsEarly;		// Members parsed before the last piece of their response arrived
+	double receiveNs;		// Time spent parsing in the write callbacks
+
+private:
+	enum State { Opening, Members, Closed, Failed };
+
+	void Parse(const char *begin, const char *end) {
+		while (state == Opening || state == Members) {
+			LightSchemaParser parser(begin + offset, end);
+			bool ok;
+
+			if (state == Opening) {
+				bool empty;
+				ok = parser.OpenCollection(empty);
+				if (ok) state = empty ? Closed : Members;
+			} else {
+				HueLight light;
+				bool last = false;
+				int id;
+
+				ok = parser.CollectionMember(id, keepLights ? &light : NULL, last);
+				if (ok) {
+					// The DOM counts repeated keys once: give up on them
+					if (seen[id / 64] & (1ULL << (id % 64))) {
+						state = Failed;
+						return;
+					}
+					seen[id / 64] |= 1ULL << (id % 64);
+					count++;
+
+					if (keepLights) lights.push_back(std::move(light));
+					if (last) state = Closed;
+				}
+			}
+
+			if (!ok) {
+				// Cut off where the text received so far ends: try again from the same place when more has arrived
+				if (!parser.Truncated()) state = Failed;
+				return;
+			}
+			offset = parser.Position() - begin;
+		}
+	}
+
+	bool keepLights;
+	State state;
+	size_t offset;						// Where the next member starts
+	size_t received;					// Bytes of the response fed so far
+	int count;							// Members parsed
+	int countBefore;					// Members parsed before the last piece arrived
+	std::vector<HueLight> lights;		// Lights parsed, in document order
+	std::vector<uint64_t> seen;			// IDs parsed, one bit each
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+/**
+ *
+ * Fixed set of worker threads, each with its own task queue.
+ *
+ * A worker runs the newest task of its own queue first (it is most likely to still be warm in its cache) and, when its
+ * queue runs dry, steals the oldest task from another worker's queue. Tasks submitted from outside the pool are spread
+ * over the queues round robin; tasks submitted from a worker go to that worker's own queue.
+*/
+class WorkStealingPool {
+public:
+	typedef std::function<void()> Task;
+
+	/**
+	 *
+	 * @param threadCount 	Number of worker threads (0 = one per core)
+	*/
+	explicit WorkStealingPool(unsigned threadCount = 0) : pending(0), steals(0), nextQueue(0), stopping(false) {
+		if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0) threadCount = 1;
+
+		for (unsigned i = 0; i < threadCount; i++) {
+			queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		}
+		for (unsigned i = 0; i < threadCount; i++) {
+			threads.push_back(std::thread(&WorkStealingPool::WorkerLoop, this, i));
+		}
+	}
+
+	// Runs the tasks that are still queued, then stops the workers
+	~WorkStealingPool() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+	}
+
+	void Submit(Task task) {
+		int own = WorkerIndex();
+		size_t index = (own >= 0 && own < (int) queues.size()) ? own : nextQueue++ % queues.size();
+
+		{
+			std::lock_guard<std::mutex> lock(queues.at(index)->mutex);
+			queues.at(index)->tasks.push_back(task);
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			pending++;
+		}
+		wake.notify_one();
+	}
+
+	size_t Size() const {
+		return threads.size();
+	}
+
+	// Number of tasks a worker took from another worker's queue
+	long Steals() const {
+		return steals;
+	}
+
+private:
+	// Copying would leave two pools joining the same threads
+	WorkStealingPool(const WorkStealingPool&);
+	WorkStealingPool& operator=(const WorkStealingPool&);
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	// Index of the worker running on this thread (-1 when called from outside the pool)
+	static int& WorkerIndex() {
+		static thread_local int index = -1;
+		return index;
+	}
+
+	bool PopOwn(size_t index, Task &task) {
+		Queue &queue = *queues.at(index);
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.tasks.empty()) return false;
+
+		task = queue.tasks.back();
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	bool Steal(size_t index, Task &task) {
+		for (size_t offset = 1; offset < queues.size(); offset++) {
+			Queue &queue = *queues.at((index + offset) % queues.size());
+			std::lock_guard<std::mutex> lock(queue.mutex);
+
+			if (queue.tasks.empty()) continue;
+
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			steals++;
+			return true;
+		}
+		return false;
+	}
+
+	void WorkerLoop(unsigned index) {
+		WorkerIndex() = index;
+
+		while (true) {
+			Task task;
+
+			if (PopOwn(index, task) || Steal(index, task)) {
+				{
+					std::lock_guard<std::mutex> lock(sleepMutex);
+					pending--;
+				}
+				task();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			if (stopping && pending == 0) return;
+			wake.wait(lock, [this]() { return stopping || pending > 0; });
+			if (stopping && pending == 0) return;
+		}
+	}
+
+	std::vector<std::unique_ptr<Queue> > queues;
+	std::vector<std::thread> threads;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	long pending;					// Tasks queued but not started (guarded by sleepMutex)
+	std::atomic<long> steals;
+	std::atomic<unsigned> nextQueue;
+	bool stopping;					// Guarded by sleepMutex
+};
+
+#endif
@@ -0,0 +1,495 @@
+/*
+ * Benchmark of the monitor's hot paths
+ *
+ * Purpose: Reproducible measurements on fixed inputs, so a change can be compared before and after on the same machine.
+ * The inputs are generated from the number of lights alone (the same text every run), and every figure is the best of
+ * --rounds runs.
+ *
+ * 	Collection parsers: a "Query all" response with --lights lights parsed by every --jsonParser (and every --simdKernel
+ * 	the CPU runs), in MB/s, ns per light and heap allocations per light, with the lights built (snapshot mode) and only
+ * 	counted (the samples). The simd rows also show the throughput of the structural scan alone.
+ *
+ * 	Light parsers: the --lights individual light responses parsed one by one by every --jsonParser, in ns per light and
+ * 	heap allocations per light (dom builds a json document for each, sax reads the fields straight into the light).
+ *
+ * 	Transports: --requests light requests in a row through the monitor's request path (connection pool, kept-alive
+ * 	connection) to a stand-in server thread in this process, over TCP loopback and over a Unix domain socket
+ * 	(--unixSocket), in requests per second.
+ *
+ * 	Light state update: heap allocations and time per sample of CompareAndUpdateLightStates on lights with long names,
+ * 	next to the loops that copied every light they looked at, and of the vector conversions copying vs moving.
+ *
+ * 	make bench
+ * 	./Benchmark -l 20000 -r 50
+ */
+
+#define HUE_LIGHT_SIMULATOR_NO_MAIN
+#define HUE_LIGHT_SIMULATOR_COUNT_ALLOCATIONS
+#include "../HUELightSimulator.cpp"
+
+/**
+ * Text of one light as a bridge (or a large emulator) sends it, the same for the same ID
+ *
+ * @param id 		ID of the light
+ * @return string 	The light object
+ */
+string BenchmarkLightText(int id) {
+	string bri = to_string(1 + (id * 37) % 254);
+	string on = id % 3 ? "true" : "false";
+
+	return "{\"state\":{\"on\":" + on + ",\"bri\":" + bri + ",\"hue\":" + to_string((id * 4099) % 65536) + ",\"sat\":254,\"effect\":\"none\","
+		"\"xy\":[0.4573,0.41],\"ct\":366,\"alert\":\"select\",\"colormode\":\"xy\",\"mode\":\"homeautomation\",\"reachable\":true},"
+		"\"swupdate\":{\"state\":\"noupdates\",\"lastinstall\":\"2021-01-18T09:51:05\"},\"type\":\"Extended color light\","
+		"\"name\":\"Hue color lamp " + to_string(id) + "\",\"modelid\":\"LCT016\",\"manufacturername\":\"Signify Netherlands B.V.\","
+		"\"productname\":\"Hue color lamp\",\"capabilities\":{\"certified\":true,\"control\":{\"mindimlevel\":1000,\"maxlumen\":800,"
+		"\"colorgamuttype\":\"C\",\"colorgamut\":[[0.6915,0.3083],[0.17,0.7],[0.1532,0.0475]],\"ct\":{\"min\":153,\"max\":500}},"
+		"\"streaming\":{\"renderer\":true,\"proxy\":true}},\"config\":{\"archetype\":\"sultanbulb\",\"function\":\"mixed\","
+		"\"direction\":\"omnidirectional\",\"startup\":{\"mode\":\"safety\",\"configured\":true}},"
+		"\"uniqueid\":\"00:17:88:01:04:" + to_string(10 + id % 90) + ":" + to_string(10 + id / 90 % 90) + ":4b-0b\",\"swversion\":\"1.76.6\"}";
+}
+
+/**
+ * Text of the "Query all" response for lights 1 to count
+ *
+ * @param count 	Number of lights
+ * @return string 	The collection
+ */
+string BenchmarkCollectionText(int count) {
+	string text = "{";
+	for (int id = 1; id <= count; id++) {
+		if (id > 1) text += ",";
+		text += "\"" + to_string(id) + "\":" + BenchmarkLightText(id);
+	}
+	return text + "}";
+}
+
+/**
+ * Best time and the allocations of one run of a piece of work
+ */
+struct BenchmarkResult {
+	double ns;
+	long allocations;
+	bool ok;
+};
+
+/**
+ * Run a piece of work rounds times
+ *
+ * @param rounds 	Number of runs
+ * @param work 		The work, returns false when it failed
+ * @return BenchmarkResult Fastest run, allocations of the last run
+ */
+BenchmarkResult Measure(int rounds, const function<bool()> &work) {
+	BenchmarkResult result = { 0, 0, true };
+
+	for (int i = 0; i < rounds; i++) {
+		long allocationsBefore = AllocationCount();
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		result.ok = work() && result.ok;
+
+		double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+		result.allocations = AllocationCount() - allocationsBefore;
+		if (i == 0 || ns < result.ns) result.ns = ns;
+	}
+	return result;
+}
+
+/**
+ * The "Query all" response parsed by every parser, with the lights built and only counted
+ *
+ * @param count 	Number of lights in the collection
+ * @param rounds 	Runs of each measurement
+ * @return Bool 	False when a parser did not make the same of the text as the DOM parser
+ */
+bool BenchmarkCollectionParsers(int count, int rounds) {
+	string text = BenchmarkCollectionText(count);
+	const char *begin = text.data(), *end = text.data() + text.size();
+	double megabytes = text.size() / 1e6;
+	bool ok = true;
+
+	struct Row { string parser; SimdLightScanner::Kernel kernel; string name; };
+	vector<Row> rows = { { "dom", SimdLightScanner::Scalar, "dom" }, { "sax", SimdLightScanner::Scalar, "sax" }, { "schema", SimdLightScanner::Scalar, "schema" } };
+	for (int kernel = SimdLightScanner::BestKernel(); kernel >= SimdLightScanner::Scalar; kernel--) {
+		SimdLightScanner::Kernel k = (SimdLightScanner::Kernel) kernel;
+		rows.push_back({ "simd", k, string("simd (") + SimdLightScanner::KernelName(k) + ")" });
+	}
+	rows.push_back({ "stream", SimdLightScanner::Scalar, "stream" });
+
+	printf("Collection parsers: %d lights, %.2f MB, best of %d runs\n\n", count, megabytes, rounds);
+	printf("%-16s %10s %10s %14s %12s %10s\n", "Parser", "MB/s", "ns/light", "allocs/light", "count MB/s", "scan MB/s");
+
+	string expected = CollectionParseOutcome("dom", SimdLightScanner::Scalar, begin, end, true);
+
+	for (const Row &row : rows) {
+		SimdLightScanner scanner;
+		StreamingLightParser streamer;
+		vector<HueLight> lights;
+		long fallbacks = 0;
+		int elements = 0;
+
+		scanner.kernel = row.kernel;
+
+		function<bool(bool)> parse = [&](bool keepLights) {
+			if (row.parser == "stream") {
+				// In the pieces libcurl hands to the write callback (CURL_MAX_WRITE_SIZE)
+				streamer.Reset(keepLights);
+				for (size_t received = 0; received < text.size();) {
+					received = min(text.size(), received + 16384);
+					streamer.Feed(begin, begin + received);
+				}
+			}
+			return ParseCollectionText(row.parser, begin, end, elements, keepLights ? &lights : NULL, NULL, scanner, &streamer, fallbacks) && elements == count;
+		};
+
+		BenchmarkResult built = Measure(rounds, [&]() { return parse(true); });
+		scanner.scannedBytes = 0;
+		scanner.scanNs = 0;
+		BenchmarkResult counted = Measure(rounds, [&]() { return parse(false); });
+
+		printf("%-16s %10.1f %10.1f %14.2f %12.1f", row.name.c_str(), megabytes / (built.ns / 1e9), built.ns / count,
+			(double) built.allocations / count, megabytes / (counted.ns / 1e9));
+		if (row.parser == "simd" && scanner.scanNs > 0) {
+			printf(" %10.1f", scanner.scannedBytes / 1e6 / (scanner.scanNs / 1e9));
+		}
+		printf("%s\n", fallbacks ? "  (fell back)" : "");
+
+		if (!built.ok || !counted.ok || CollectionParseOutcome(row.parser, row.kernel, begin, end, true) != expected) {
+			fprintf(stderr, "Function BenchmarkCollectionParsers: %s does not parse the collection like dom\n", row.name.c_str());
+			ok = false;
+		}
+	}
+	printf("\n");
+	return ok;
+}
+
+/**
+ * The individual light responses parsed one by one by every parser
+ *
+ * @param count 	Number of lights
+ * @param rounds 	Runs of each measurement
+ * @return Bool 	False when a parser did not make the same of a response as the DOM parser
+ */
+bool BenchmarkLightParsers(int count, int rounds) {
+	vector<string> texts;
+	size_t bytes = 0;
+	bool ok = true;
+
+	for (int id = 1; id <= count; id++) {
+		texts.push_back(BenchmarkLightText(id));
+		bytes += texts.back().size();
+	}
+
+	// The stream parser parses the light responses with the schema parser
+	vector<string> parsers = { "dom", "sax", "schema", "simd" };
+
+	printf("Light parsers: %d responses of %zu bytes on average, best of %d runs\n\n", count, bytes / count, rounds);
+	printf("%-16s %10s %14s\n", "Parser", "ns/light", "allocs/light");
+
+	for (const string &parser : parsers) {
+		SimdLightScanner scanner;
+		long fallbacks = 0;
+		HueLight light;
+
+		BenchmarkResult result = Measure(rounds, [&]() {
+			bool parsed = true;
+			for (int id = 1; id <= count; id++) {
+				const string &text = texts[id - 1];
+				parsed = ParseLightText(parser, text.data(), text.data() + text.size(), id, light, scanner, fallbacks) && parsed;
+			}
+			return parsed;
+		});
+
+		string name = parser == "simd" ? string("simd (") + SimdLightScanner::KernelName(scanner.kernel) + ")" : parser;
+		printf("%-16s %10.1f %14.2f%s\n", name.c_str(), result.ns / count, (double) result.allocations / count, fallbacks ? "  (fell back)" : "");
+
+		for (int id = 1; id <= count && ok; id++) {
+			const string &text = texts[id - 1];
+			if (LightParseOutcome(parser, scanner.kernel, text.data(), text.data() + text.size(), id) != LightParseOutcome("dom", scanner.kernel, text.data(), text.data() + text.size(), id)) {
+				fprintf(stderr, "Function BenchmarkLightParsers: %s does not parse light %d like dom\n", name.c_str(), id);
+				ok = false;
+			}
+		}
+		ok = ok && result.ok;
+	}
+	printf("\n");
+	return ok;
+}
+
+/**
+ * Answers every request on its connections with the same light response, keeping the connections alive. Listens on
+ * 127.0.0.1 (port picked by the system) or on a Unix domain socket, from a thread of its own.
+ */
+class StandInServer {
+public:
+	/**
+	 * @param unixSocket 	Path of the socket to listen on ("" = TCP loopback)
+	 * @param body 			Body of every response
+	*/
+	StandInServer(const string &unixSocket, const string &body) : path(unixSocket), port(0) {
+		response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+
+		if (path.empty()) {
+			listener = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in address = sockaddr_in();
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t length = sizeof(address);
+			bind(listener, (sockaddr*) &address, length);
+			getsockname(listener, (sockaddr*) &address, &length);
+			port = ntohs(address.sin_port);
+		} else {
+			listener = socket(AF_UNIX, SOCK_STREAM, 0);
+			sockaddr_un address = sockaddr_un();
+			address.sun_family = AF_UNIX;
+			strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+			unlink(path.c_str());
+			bind(listener, (sockaddr*) &address, sizeof(address));
+		}
+
+		if (listen(listener, 16) != 0) {
+			fprintf(stderr, "Function StandInServer: unable to listen on %s\n", path.empty() ? "127.0.0.1" : path.c_str());
+		}
+		server = thread([this]() { Serve(); });
+	}
+
+	~StandInServer() {
+		// Wakes accept() up with an error
+		shutdown(listener, SHUT_RDWR);
+		server.join();
+		close(listener);
+		if (!path.empty()) unlink(path.c_str());
+	}
+
+	string path;
+	int port;
+
+private:
+	void Serve() {
+		int connection;
+
+		while ((connection = accept(listener, NULL, NULL)) >= 0) {
+			if (path.empty()) {
+				int on = 1;
+				setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+			}
+
+			// One response per request head received, until the client closes the connection
+			string received;
+			char buffer[4096];
+			ssize_t length;
+			while ((length = read(connection, buffer, sizeof(buffer))) > 0) {
+				received.append(buffer, length);
+				size_t end;
+				while ((end = received.find("\r\n\r\n")) != string::npos) {
+					received.erase(0, end + 4);
+					if (write(connection, response.data(), response.size()) != (ssize_t) response.size()) break;
+				}
+			}
+			close(connection);
+		}
+	}
+
+	string response;
+	int listener;
+	thread server;
+};
+
+/**
+ * Light requests in a row over TCP loopback and over a Unix domain socket
+ *
+ * @param requests 	Requests per run
+ * @param rounds 	Runs of each measurement
+ * @return Bool 	False when a request failed
+ */
+bool BenchmarkTransports(int requests, int rounds) {
+	string body = BenchmarkLightText(1);
+	bool ok = true;
+
+	printf("Transports: %d light requests of %zu bytes in a row on one kept-alive connection, best of %d runs\n\n", requests, body.size(), rounds);
+	printf("%-16s %12s %12s\n", "Transport", "requests/s", "us/request");
+
+	for (int socketFile = 0; socketFile <= 1; socketFile++) {
+		StandInServer server(socketFile ? "/tmp/HUELightBenchmark-" + to_string(getpid()) + ".sock" : "", body);
+
+		SimulationOptions options = SimulationOptions();
+		options.hostname = "127.0.0.1";
+		options.port = server.port ? server.port : 80;
+		options.unixSocket = server.path;
+		options.timeout = 10;
+		options.sleep = 1000000;
+		options.maxInFlight = 1;
+		options.simdKernel = "auto";
+
+		BridgeMonitor bridge("", options.hostname, options.port, "newdeveloper", options);
+		string urlString = bridge.urlString + "1";
+		string poolKey = ConnectionPool::KeyFromURL(urlString);
+		ReceiveBuffer responseString;
+
+		BenchmarkResult result = Measure(rounds, [&]() {
+			bool done = true;
+			for (int i = 0; i < requests && done; i++) {
+				responseString.Clear();
+				CURL *curl = CreateHTTPCurlHandle(bridge, urlString, options, &responseString);
+				done = curl && MakeHTTPRequest(curl, bridge.limiter) && responseString.Size() == body.size();
+				if (curl) bridge.pool.Release(poolKey, curl);
+			}
+			return done;
+		});
+
+		printf("%-16s %12.0f %12.1f\n", socketFile ? "unix socket" : "tcp loopback", requests / (result.ns / 1e9), result.ns / 1e3 / requests);
+		ok = ok && result.ok;
+	}
+	printf("\n");
+	return ok;
+}
+
+/**
+ * CompareAndUpdateLightStates as it was with its loops by value: every light it looks at is copied (name included), the
+ * new lights too as they are passed by value. Kept here to compare with.
+ *
+ * @param currentLightsState 	Lights known from the last sample
+ * @param newLights 			Lights found in this sample
+ * @param out 					Stream the changes are printed to
+ * @return Integer 				Number of changes printed
+ */
+int CopyingCompareAndUpdateLightStates(vector<HueLight> &currentLightsState, vector<HueLight> newLights, ostream &out) {
+	int changes = 0;
+
+	setIsValid(currentLightsState, false);
+
+	for (auto light : newLights) {
+		int foundIt = false;
+		int index = 0;
+
+		for (auto existinglight : currentLightsState) {
+			if (existinglight.id == light.id) {
+				foundIt = true;
+				HueLight &known = currentLightsState.at(index);
+				known.isValid = true;
+				known.stale = light.stale;
+				changes += UpdateLightField(known.on, light.on, "on", light.id, out, "");
+				changes += UpdateLightField(known.brightness, light.brightness, "brightness", light.id, out, "");
+				changes += UpdateLightField(known.name, light.name, "name", light.id, out, "");
+				break;
+			}
+			index++;
+		}
+		if (!foundIt) {
+			PrintDiscoveredLight(light, out, "");
+			light.isValid = true;
+			currentLightsState.push_back(light);
+			changes++;
+		}
+	}
+
+	for (int i = 0; i < currentLightsState.size(); i++) {
+		if (!currentLightsState.at(i).isValid) {
+			PrintRemovedLight(currentLightsState.at(i).id, out, "");
+			currentLightsState.erase(currentLightsState.begin() + i);
+			changes++;
+		}
+	}
+	return changes;
+}
+
+/**
+ * Comparing and updating the light states once per sample, and converting the lights to and from json
+ *
+ * @param count 	Number of lights (the copying loops are quadratic, keep it to a few hundred)
+ * @param rounds 	Runs of each measurement
+ * @return Bool 	False when the copying loops do not find the same changes
+ */
+bool BenchmarkLightStateUpdate(int count, int rounds) {
+	// Two samples in turn, every tenth light differs between them: each sample finds count / 10 lights changed
+	vector<HueLight> samples[2];
+	for (int id = 1; id <= count; id++) {
+		for (int sample = 0; sample < 2; sample++) {
+			HueLight light;
+			light.id = id;
+			light.name = "Living room ceiling lamp " + to_string(id) + " by the north window";
+			light.on = sample == 1 && id % 10 == 0;
+			SetLightBrightness(light, sample == 1 && id % 10 == 0 ? 200 : 100);
+			light.isValid = true;
+			light.stale = false;
+			samples[sample].push_back(light);
+		}
+	}
+
+	// The changes are formatted as they would be printed, and thrown away
+	ostream out(NULL);
+	bool ok = true;
+
+	printf("Light state update: %d lights with %zu character names, %d changes per sample, best of %d runs\n\n", count, samples[0][0].name.size(), count / 10 * 2, rounds);
+	printf("%-28s %12s %14s\n", "Per sample", "us", "allocations");
+
+	for (int copying = 0; copying <= 1; copying++) {
+		vector<HueLight> known = samples[0];
+		int tick = 0, changes = 0;
+
+		BenchmarkResult result = Measure(rounds * 2, [&]() {
+			vector<HueLight> &lights = samples[++tick % 2];
+			changes = copying ? CopyingCompareAndUpdateLightStates(known, lights, out) : CompareAndUpdateLightStates(known, lights, out, "");
+			return changes == count / 10 * 2;
+		});
+
+		printf("%-28s %12.1f %14ld\n", copying ? "compare, copying loops" : "compare, by reference", result.ns / 1e3, result.allocations);
+		ok = ok && result.ok;
+	}
+
+	// A fresh copy for every run of the conversions that consume their argument
+	vector<vector<HueLight> > copies(rounds, samples[0]);
+	json document = json::parse(to_json_vector(samples[0]).dump());
+	vector<json> documents(rounds, document);
+	size_t next = 0;
+
+	BenchmarkResult copied = Measure(rounds, [&]() { return to_json_vector(samples[0]).size() == (size_t) count; });
+	printf("%-28s %12.1f %14ld\n", "to_json_vector, copy", copied.ns / 1e3, copied.allocations);
+
+	BenchmarkResult moved = Measure(rounds, [&]() { return to_json_vector(std::move(copies[next++])).size() == (size_t) count; });
+	printf("%-28s %12.1f %14ld\n", "to_json_vector, move", moved.ns / 1e3, moved.allocations);
+
+	next = 0;
+	BenchmarkResult parsedCopy = Measure(rounds, [&]() { return to_HueLight_vector(document).size() == (size_t) count; });
+	printf("%-28s %12.1f %14ld\n", "to_HueLight_vector, copy", parsedCopy.ns / 1e3, parsedCopy.allocations);
+
+	BenchmarkResult parsedMove = Measure(rounds, [&]() { return to_HueLight_vector(std::move(documents[next++])).size() == (size_t) count; });
+	printf("%-28s %12.1f %14ld\n", "to_HueLight_vector, move", parsedMove.ns / 1e3, parsedMove.allocations);
+
+	printf("\n");
+	return ok && copied.ok && moved.ok && parsedCopy.ok && parsedMove.ok;
+}
+
+void configure_benchmark(cli::Parser& parser) {
+	parser.set_optional<int>("l", "lights", 5000, "Number of lights in the \"Query all\" response.");
+	parser.set_optional<int>("r", "rounds", 20, "Runs of each measurement, the fastest one is shown.");
+	parser.set_optional<int>("q", "requests", 2000, "Requests per run of the transport measurements.");
+}
+
+int main(int argc, char *argv[]) {
+	cli::Parser arguments(argc, argv);
+	configure_benchmark(arguments);
+	arguments.run_and_exit_if_error();
+
+	int lights = arguments.get<int>("l");
+	int rounds = arguments.get<int>("r");
+	int requests = arguments.get<int>("q");
+
+	if (lights < 1 || lights > SimdLightScanner::MaxId || rounds < 1 || requests < 1) {
+		printf("\n--lights must be between 1 and %d, --rounds and --requests at least 1.\n", SimdLightScanner::MaxId);
+		return 1;
+	}
+
+	printf("Best SIMD kernel:\t\t%s\n\n", SimdLightScanner::KernelName(SimdLightScanner::BestKernel()));
+
+	bool ok = BenchmarkCollectionParsers(lights, rounds);
+	ok = BenchmarkLightParsers(lights, rounds) && ok;
+
+	ok = BenchmarkLightStateUpdate(min(lights, 200), rounds) && ok;
+
+	curl_global_init(CURL_GLOBAL_ALL);
+	ok = BenchmarkTransports(requests, rounds) && ok;
+	curl_global_cleanup();
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+Checks that a resync corrects a wrong event stream event.
+
+Starts tools/StandInBridge.py with lights that never change, which pushes one event that turns light 1 off while the
+bridge keeps serving it on. The monitor (--eventStream, a resync every 2 seconds) has to print the event and then turn the
+light back on at the next resync, with the lights requested one by one and from the snapshot (--snapshot). Exits with 1
+when it does not.
+
+	make test
+	python3 tools/EventStreamResyncTest.py ./HUELightSimulation
+"""
+import os
+import pty
+import re
+import select
+import signal
+import socket
+import subprocess
+import sys
+import time
+
+here = os.path.dirname(os.path.abspath(__file__))
+monitor = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, "..", "HUELightSimulation")
+
+# A change of light 1's power as the monitor prints it
+powerChange = re.compile(r'\{\s*"id": 1,\s*"on": (true|false)\s*\}')
+caughtByResyncs = re.compile(r"(\d+) changes caught by resyncs")
+
+
+def FreePort():
+	with socket.socket() as s:
+		s.bind(("127.0.0.1", 0))
+		return s.getsockname()[1]
+
+
+# Output of the monitor run for some seconds. On a terminal, so what it prints is not held in a buffer when it is stopped
+def Monitor(arguments, seconds):
+	master, slave = pty.openpty()
+	process = subprocess.Popen([monitor] + arguments, stdout=slave, stderr=subprocess.DEVNULL)
+	os.close(slave)
+
+	output = b""
+	deadline = time.time() + seconds
+	while time.time() < deadline:
+		if not select.select([master], [], [], max(0, deadline - time.time()))[0]:
+			continue
+		try:
+			output += os.read(master, 65536)
+		except OSError:
+			break
+	process.kill()
+	process.wait()
+	os.close(master)
+	return output
+
+
+def Run(mode):
+	port = FreePort()
+	bridge = subprocess.Popen([sys.executable, os.path.join(here, "StandInBridge.py"), "--port", str(port), "--lights", "3", "--changeEvery", "0", "--wrongEventAfter", "1"], stdout=subprocess.PIPE)
+	try:
+		# Listening once it printed its address
+		bridge.stdout.readline()
+		output = Monitor(["-p", str(port), "-s", "30", "-E", "-i", "1"] + mode, 6)
+	finally:
+		bridge.send_signal(signal.SIGINT)
+		bridge.wait()
+
+	output = output.decode(errors="replace")
+	output = output[output.find("Begin simulation"):]
+	changes = powerChange.findall(output)
+	caught = [int(n) for n in caughtByResyncs.findall(output)]
+
+	name = " ".join(mode) or "light requests"
+	if changes != ["false", "true"] or not caught or caught[-1] != 1:
+		print("FAILED %s: light 1 power changes %s, changes caught by resyncs %s" % (name, changes, caught))
+		return False
+	print("ok %s: the wrong event was reverted by the next resync" % name)
+	return True
+
+
+if __name__ == "__main__":
+	ok = True
+	for mode in ([], ["-S"]):
+		ok = Run(mode) and ok
+	sys.exit(0 if ok else 1)
@@ -0,0 +1,206 @@
+/*
+ * Differential fuzzer of the JSON parsers
+ *
+ * Purpose: Checks every fast parser (--jsonParser sax, schema, simd with each kernel the CPU runs, and stream) against the
+ * DOM parser on a generated corpus of light and "Query all" responses and on mutated copies of them (see ParserVerifier).
+ * The corpus is made of what the fast paths find hard: escapes, \u escapes and surrogate pairs, UTF-8, numbers with
+ * fractions and exponents, repeated keys, deep nesting, unusual whitespace, members that are not lights. Every
+ * disagreement is printed to stderr with its text, and the program exits with 1 when there was any.
+ *
+ * 	make fuzz
+ * 	./ParserFuzzer -s 7 -c 1000 -m 200
+ */
+
+#define HUE_LIGHT_SIMULATOR_NO_MAIN
+#include "../HUELightSimulator.cpp"
+#include <random>
+
+/**
+ * Makes the texts of the corpus, the same ones for the same seed.
+ */
+class CorpusGenerator {
+public:
+	CorpusGenerator(unsigned seed) : random(seed) {}
+
+	// Text of an individual light response
+	string Light() {
+		vector<string> members;
+
+		members.push_back(Member("state", State()));
+		members.push_back(Member("type", "\"Extended color light\""));
+		members.push_back(Member("name", Pick(names)));
+		members.push_back(Member("modelid", "\"LCT016\""));
+		members.push_back(Member("swversion", "\"1.46.13_r26312\""));
+		if (Chance(3)) members.push_back(Member("capabilities", Nested(1 + random() % 40)));
+		if (Chance(4)) members.push_back(Member("config", "{\"archetype\":\"sultanbulb\",\"startup\":{\"mode\":\"safety\",\"configured\":true},\"values\":[1,2.5,-3e2,4E-1,null,\"x\"]}"));
+		if (Chance(6)) members.push_back(Member("name", Pick(names)));
+		// Sometimes not a light at all
+		if (Chance(12)) members.erase(members.begin() + random() % members.size());
+
+		return Object(members);
+	}
+
+	// Text of a "Query all" response
+	string Collection() {
+		vector<string> members;
+		int count = random() % 12;
+
+		for (int id = 1; id <= count; id++) {
+			string key = to_string(id);
+			if (Chance(15)) key = Pick(keys);
+			members.push_back(Member(key, Chance(15) ? Pick(values) : Light()));
+			// The same ID twice
+			if (Chance(15)) members.push_back(Member(key, Light()));
+		}
+
+		return Object(members);
+	}
+
+private:
+	string State() {
+		vector<string> members;
+
+		members.push_back(Member("on", Chance(2) ? "true" : "false"));
+		members.push_back(Member("bri", Pick(brightness)));
+		members.push_back(Member("hue", "44506"));
+		members.push_back(Member("xy", "[0.3227,0.329]"));
+		members.push_back(Member("alert", "\"none\""));
+		members.push_back(Member("reachable", "true"));
+		if (Chance(6)) members.push_back(Member("bri", Pick(brightness)));
+		if (Chance(8)) members.push_back(Member("on", Pick(values)));
+		if (Chance(12)) members.erase(members.begin() + random() % members.size());
+
+		return Object(members);
+	}
+
+	// Arrays and objects nested depth deep
+	string Nested(int depth) {
+		string text;
+		for (int i = 0; i < depth; i++) text += i % 2 ? "{\"n\":" : "[";
+		text += Pick(values);
+		for (int i = depth - 1; i >= 0; i--) text += i % 2 ? "}" : "]";
+		return text;
+	}
+
+	// The members in random order, with random whitespace around the tokens
+	string Object(vector<string> &members) {
+		shuffle(members.begin(), members.end(), random);
+
+		string text = "{" + Space();
+		for (size_t i = 0; i < members.size(); i++) {
+			if (i > 0) text += "," + Space();
+			text += members[i];
+		}
+		return text + Space() + "}";
+	}
+
+	string Member(const string &key, const string &value) {
+		return "\"" + key + "\"" + Space() + ":" + Space() + value + Space();
+	}
+
+	string Space() {
+		static const char *spaces[] = { "", "", "", " ", "\n\t", "\r\n  ", "\t \t" };
+		return spaces[random() % (sizeof(spaces) / sizeof(spaces[0]))];
+	}
+
+	bool Chance(int in) {
+		return random() % in == 0;
+	}
+
+	const string &Pick(const vector<string> &from) {
+		return from[random() % from.size()];
+	}
+
+	std::mt19937 random;
+
+	const vector<string> names = {
+		"\"Hue color lamp 1\"", "\"\"", "\"Caf\\u00e9 lamp\"", "\"K\xc3\xbc" "che\"", "\"Quote \\\" and backslash \\\\\"",
+		"\"Tab\\tnewline\\nslash\\/\"", "\"Bulb \\ud83d\\udca1\"", "\"Lone \\ud83d surrogate\"", "\"\\u0000 nul\"",
+		"\"" + string(300, 'x') + "\"", "\"\\b\\f\\r\"", "\"bad \\x escape\"", "17", "null", "[\"array\"]"
+	};
+	const vector<string> brightness = {
+		"254", "1", "0", "127", "255", "-1", "1000000", "1e2", "2.54E2", "100.0", "127.5", "-0", "1.0e+2", "25e-1",
+		"0.0", "\"128\"", "true", "null", "99999999999999999999"
+	};
+	const vector<string> keys = { "0", "-1", "abc", "1.5", "01", "4096", "99999", "1e3", "" };
+	const vector<string> values = { "null", "true", "false", "0", "-1.25e-3", "\"text\"", "[]", "{}", "[1,[2,[3]]]" };
+};
+
+/**
+ * One parser checked against the DOM parser, with its own verifier so every parser sees the same mutated copies.
+ */
+struct CheckedParser {
+	string parser;
+	SimdLightScanner::Kernel kernel;
+	string name;
+	ParserVerifier lights;
+	ParserVerifier collections;
+
+	CheckedParser(const string &parser, SimdLightScanner::Kernel kernel, const string &name, unsigned seed, int mutations) :
+		parser(parser),
+		kernel(kernel),
+		name(name),
+		lights(seed, mutations),
+		collections(seed, mutations) {}
+};
+
+void configure_fuzzer(cli::Parser& parser) {
+	parser.set_optional<int>("s", "seed", 20210202, "Seed of the corpus and of the mutations.");
+	parser.set_optional<int>("c", "corpus", 300, "Number of light responses and of \"Query all\" responses generated.");
+	parser.set_optional<int>("m", "mutations", 64, "Mutated copies checked per generated response.");
+}
+
+int main(int argc, char *argv[]) {
+	cli::Parser arguments(argc, argv);
+	configure_fuzzer(arguments);
+	arguments.run_and_exit_if_error();
+
+	unsigned seed = arguments.get<int>("s");
+	int corpus = arguments.get<int>("c");
+	int mutations = arguments.get<int>("m");
+
+	vector<unique_ptr<CheckedParser>> parsers;
+	parsers.emplace_back(new CheckedParser("sax", SimdLightScanner::Scalar, "sax", seed, mutations));
+	parsers.emplace_back(new CheckedParser("schema", SimdLightScanner::Scalar, "schema", seed, mutations));
+	for (int kernel = SimdLightScanner::Scalar; kernel <= SimdLightScanner::BestKernel(); kernel++) {
+		SimdLightScanner::Kernel k = (SimdLightScanner::Kernel) kernel;
+		parsers.emplace_back(new CheckedParser("simd", k, string("simd (") + SimdLightScanner::KernelName(k) + ")", seed, mutations));
+	}
+	parsers.emplace_back(new CheckedParser("stream", SimdLightScanner::Scalar, "stream", seed, mutations));
+
+	CorpusGenerator generator(seed);
+	long mismatches = 0;
+
+	for (int i = 0; i < corpus; i++) {
+		string light = generator.Light();
+		string collection = generator.Collection();
+		int id = 1 + i % 64;
+		bool keepLights = i % 2 == 0;
+
+		for (unique_ptr<CheckedParser> &checked : parsers) {
+			CheckedParser &c = *checked;
+
+			c.lights.Verify(light.data(), light.data() + light.size(), [&c, id](const char *begin, const char *end, bool reference) {
+				return LightParseOutcome(reference ? "dom" : c.parser, c.kernel, begin, end, id);
+			});
+			c.collections.Verify(collection.data(), collection.data() + collection.size(), [&c, keepLights](const char *begin, const char *end, bool reference) {
+				return CollectionParseOutcome(reference ? "dom" : c.parser, c.kernel, begin, end, keepLights);
+			});
+		}
+	}
+
+	printf("Seed %u, %d generated responses of each kind, %d mutated copies each\n\n", seed, corpus, mutations);
+	for (unique_ptr<CheckedParser> &checked : parsers) {
+		CheckedParser &c = *checked;
+		printf("%-16s lights: %ld texts, %ld disagreements\tcollections: %ld texts, %ld disagreements\n", c.name.c_str(),
+			c.lights.responses + c.lights.mutations, c.lights.mismatches, c.collections.responses + c.collections.mutations, c.collections.mismatches);
+		mismatches += c.lights.mismatches + c.collections.mismatches;
+	}
+
+	if (mismatches > 0) {
+		printf("\n%ld disagreements with the DOM parser (printed to stderr)\n", mismatches);
+		return 1;
+	}
+	printf("\nNo disagreements with the DOM parser\n");
+	return 0;
+}
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""
+Stand-in for a Hue bridge on the loopback interface, to run the monitor against offline.
+
+It serves GET /api/<username>/lights (the "Query all" collection) and GET /api/<username>/lights/<id> for a number of
+lights, and changes one light at random every --changeEvery seconds. Every response carries an ETag and a Last-Modified
+header, and a request that sends them back (If-None-Match / If-Modified-Since) for a resource that did not change is
+answered "304 Not Modified" without a body, like a bridge or a caching proxy in front of it would.
+
+	python3 tools/StandInBridge.py --port 8080 --lights 20
+	./HUELightSimulation -p 8080 -s 600 -i 50
+
+The monitor's --statsInterval counters then show the 304 responses and the body bytes they saved. --noValidators turns
+the headers off to compare. The requests served and the 304s are printed when the server is stopped (Ctrl-C).
+
+It also serves the Hue v2 event stream (GET /eventstream/clip/v2, Server-Sent Events): every change is pushed as an
+"update" event for the light resource ("id_v1": "/lights/<id>", "on", "dimming"). --churn removes the last light or brings
+the last removed one back on some of the changes ("delete" / "add" events), --dropStreamAfter ends the stream after that many
+events so the monitor reconnects, and a reconnect that sends Last-Event-ID gets the events it missed replayed first.
+--wrongEventAfter pushes one event that light 1 does not match, which the monitor's next resync has to correct.
+
+	python3 tools/StandInBridge.py --port 8080 --lights 20 --changeEvery 0.5 --churn --dropStreamAfter 10
+	./HUELightSimulation -p 8080 -s 1 -E -i 5
+"""
+import argparse
+import hashlib
+import json
+import queue
+import random
+import threading
+import time
+from email.utils import formatdate, parsedate_to_datetime
+from http.server import ThreadingHTTPServer, BaseHTTPRequestHandler
+
+arguments = argparse.ArgumentParser(description="Stand-in Hue bridge on the loopback interface.")
+arguments.add_argument("--port", type=int, default=8080, help="Port to listen on (127.0.0.1).")
+arguments.add_argument("--lights", type=int, default=5, help="Number of lights.")
+arguments.add_argument("--changeEvery", type=float, default=2.0, help="Seconds between changes to a random light (0 = never).")
+arguments.add_argument("--noValidators", action="store_true", help="Send no ETag / Last-Modified and never answer 304.")
+arguments.add_argument("--churn", action="store_true", help="Remove the last light or bring the last removed one back on every fifth change.")
+arguments.add_argument("--wrongEventAfter", type=float, default=0, help="Seconds after the start to push one event that turns light 1 the wrong way, without changing it (0 = never).")
+arguments.add_argument("--dropStreamAfter", type=int, default=0, help="End each event stream connection after that many events (0 = never).")
+options = arguments.parse_args()
+
+lock = threading.Lock()
+lights = {}
+# Time each light last changed (whole seconds, the resolution of Last-Modified)
+modified = {}
+counts = {"requests": 0, "notModified": 0, "events": 0, "streams": 0}
+removed = {}
+# Events sent so far as (number, text), to replay after Last-Event-ID, and the queues of the open streams
+history = []
+subscribers = []
+
+for i in range(1, options.lights + 1):
+	lights[str(i)] = {"state": {"on": True, "bri": 1 + (i * 37) % 254, "alert": "none"}, "type": "Dimmable light", "name": "Light %d" % i, "modelid": "LWB006", "swversion": "1"}
+	modified[str(i)] = int(time.time())
+
+
+def LightResource(id):
+	resource = {"id": "light-%s" % id, "id_v1": "/lights/%s" % id, "type": "light"}
+	if id in lights:
+		state = lights[id]["state"]
+		resource["on"] = {"on": state["on"]}
+		resource["dimming"] = {"brightness": round(state["bri"] * 100.0 / 254, 2)}
+		resource["metadata"] = {"name": lights[id]["name"]}
+	return resource
+
+
+# Called with the lock held
+def Publish(type, id, resource=None):
+	number = len(history) + 1
+	event = [{"creationtime": time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime()), "id": "event-%d" % number, "type": type, "data": [resource or LightResource(id)]}]
+	text = "id: %d:0\ndata: %s\n\n" % (number, json.dumps(event))
+	history.append((number, text))
+	del history[:-1000]
+	for subscriber in subscribers:
+		subscriber.put(text)
+
+
+def ChangeLights():
+	changes = 0
+	while True:
+		time.sleep(options.changeEvery)
+		with lock:
+			changes += 1
+			# The monitor asks for lights 1 to the number of lights: only the last one comes and goes
+			if options.churn and changes % 5 == 0:
+				if removed and (random.random() < 0.5 or len(lights) <= 1):
+					id = str(len(lights) + 1)
+					lights[id] = removed.pop(id)
+					modified[id] = int(time.time())
+					Publish("add", id)
+					continue
+				if len(lights) > 1:
+					id = str(len(lights))
+					removed[id] = lights.pop(id)
+					del modified[id]
+					Publish("delete", id)
+					continue
+
+			id = random.choice(list(lights.keys()))
+			lights[id]["state"]["on"] = not lights[id]["state"]["on"]
+			lights[id]["state"]["bri"] = random.randint(1, 254)
+			modified[id] = int(time.time())
+			Publish("update", id)
+
+
+class StandInBridge(BaseHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def log_message(self, *args):
+		pass
+
+	def do_GET(self):
+		parts = [part for part in self.path.split("/") if part]
+
+		if parts == ["eventstream", "clip", "v2"]:
+			self.EventStream()
+			return
+
+		with lock:
+			counts["requests"] += 1
+			if len(parts) == 3 and parts[0] == "api" and parts[2] == "lights":
+				body = lights
+				lastModified = max(modified.values()) if modified else 0
+			elif len(parts) == 4 and parts[0] == "api" and parts[2] == "lights" and parts[3] in lights:
+				body = lights[parts[3]]
+				lastModified = modified[parts[3]]
+			else:
+				body = [{"error": {"type": 3, "address": self.path, "description": "resource not available"}}]
+				lastModified = None
+			data = json.dumps(body).encode()
+
+		headers = {"Content-Type": "application/json"}
+		if not options.noValidators and lastModified is not None:
+			headers["ETag"] = '"%s"' % hashlib.md5(data).hexdigest()
+			headers["Last-Modified"] = formatdate(lastModified, usegmt=True)
+
+			if self.NotModified(headers["ETag"], lastModified):
+				with lock:
+					counts["notModified"] += 1
+				self.Send(304, headers, b"")
+				return
+
+		self.Send(200, headers, data)
+
+	# If-None-Match wins over If-Modified-Since when both are sent (RFC 7232)
+	def NotModified(self, etag, lastModified):
+		ifNoneMatch = self.headers.get("If-None-Match")
+		if ifNoneMatch is not None:
+			return etag in [tag.strip() for tag in ifNoneMatch.split(",")]
+
+		ifModifiedSince = self.headers.get("If-Modified-Since")
+		if ifModifiedSince is not None:
+			try:
+				return lastModified <= parsedate_to_datetime(ifModifiedSince).timestamp()
+			except (TypeError, ValueError):
+				return False
+		return False
+
+	# Server-Sent Events over a chunked response, until the client goes away or --dropStreamAfter events were sent
+	def EventStream(self):
+		# Only a reconnect that says where it stopped gets the events it missed
+		lastEventId = self.headers.get("Last-Event-ID")
+		try:
+			after = int(lastEventId.split(":")[0]) if lastEventId else None
+		except ValueError:
+			after = None
+
+		events = queue.Queue()
+		with lock:
+			counts["streams"] += 1
+			for number, text in history:
+				if after is not None and number > after:
+					events.put(text)
+			subscribers.append(events)
+
+		self.send_response(200)
+		self.send_header("Content-Type", "text/event-stream")
+		self.send_header("Cache-Control", "no-cache")
+		self.send_header("Transfer-Encoding", "chunked")
+		self.end_headers()
+
+		sent = 0
+		try:
+			self.WriteChunk(": hi\n\n")
+			while not options.dropStreamAfter or sent < options.dropStreamAfter:
+				try:
+					text = events.get(timeout=10)
+				except queue.Empty:
+					# Keep-alive comment, the monitor skips it
+					self.WriteChunk(": hi\n\n")
+					continue
+				self.WriteChunk(text)
+				sent += 1
+				with lock:
+					counts["events"] += 1
+			self.wfile.write(b"0\r\n\r\n")
+		except (BrokenPipeError, ConnectionResetError):
+			pass
+		finally:
+			with lock:
+				subscribers.remove(events)
+		self.close_connection = True
+
+	def WriteChunk(self, text):
+		data = text.encode()
+		self.wfile.write(b"%x\r\n" % len(data) + data + b"\r\n")
+		self.wfile.flush()
+
+	def Send(self, status, headers, data):
+		self.send_response(status)
+		for name, value in headers.items():
+			self.send_header(name, value)
+		self.send_header("Content-Length", str(len(data)))
+		self.end_headers()
+		self.wfile.write(data)
+
+
+# An event the light does not match, like one that was sent out of order: the monitor's resyncs have to correct it
+def PublishWrongEvent():
+	time.sleep(options.wrongEventAfter)
+	with lock:
+		resource = LightResource("1")
+		resource["on"] = {"on": not lights["1"]["state"]["on"]}
+		Publish("update", "1", resource)
+
+
+if options.changeEvery > 0:
+	threading.Thread(target=ChangeLights, daemon=True).start()
+if options.wrongEventAfter > 0:
+	threading.Thread(target=PublishWrongEvent, daemon=True).start()
+
+server = ThreadingHTTPServer(("127.0.0.1", options.port), StandInBridge)
+print("Stand-in bridge with %d lights on http://127.0.0.1:%d/api/newdeveloper/lights" % (options.lights, options.port), flush=True)
+try:
+	server.serve_forever()
+except KeyboardInterrupt:
+	pass
+print("\n%d requests served, %d answered 304 Not Modified, %d events sent on %d event streams" % (counts["requests"], counts["notModified"], counts["events"], counts["streams"]))